@@ -4,6 +4,56 @@ out vec4 FragColor;
 
 uniform sampler2D accumTex;
 
+// -- Heatmap Views -- (TraversalStats::View)
+const int VIEW_COLOR = 0;
+const int VIEW_NODES = 1;
+const int VIEW_AABB_TESTS = 2;
+const int VIEW_TRIANGLE_TESTS = 3;
+const int VIEW_BOUNCES = 4;
+
+uniform int view;
+uniform float viewMax; // value mapped to the top of the color ramp
+
+struct PixelStats {
+    uint nodes;
+    uint aabbTests;
+    uint triangleTests;
+    uint rays;
+    uint bounces;
+    uint paths;
+    uint maxNodes;
+    uint pad;
+};
+
+layout(std430, binding = 6) readonly buffer TraversalStats {
+    PixelStats pixelStats[];
+};
+
+// blue -> cyan -> green -> yellow -> red
+vec3 falseColor(float t){
+    t = clamp(t, 0.0, 1.0) * 4.0;
+    vec3 ramp[5] = vec3[5](vec3(0, 0, 1), vec3(0, 1, 1), vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 0, 0));
+    int i = min(int(t), 3);
+    return mix(ramp[i], ramp[i + 1], t - float(i));
+}
+
 void main() {
-    FragColor = texture(accumTex, uv);
-}
\ No newline at end of file
+    if (view == VIEW_COLOR) {
+        FragColor = vec4(texture(accumTex, uv).rgb, 1.0); // alpha holds the sample count
+        return;
+    }
+
+    ivec2 size = textureSize(accumTex, 0);
+    ivec2 pixel = min(ivec2(uv * vec2(size)), size - 1);
+    PixelStats s = pixelStats[pixel.y * size.x + pixel.x];
+
+    // traversal costs per ray, bounces per path
+    float rays = max(float(s.rays), 1.0);
+    float value = 0.0;
+    if (view == VIEW_NODES) value = float(s.nodes) / rays;
+    else if (view == VIEW_AABB_TESTS) value = float(s.aabbTests) / rays;
+    else if (view == VIEW_TRIANGLE_TESTS) value = float(s.triangleTests) / rays;
+    else if (view == VIEW_BOUNCES) value = float(s.bounces) / max(float(s.paths), 1.0);
+
+    FragColor = vec4(falseColor(value / max(viewMax, 1e-6)), 1.0);
+}
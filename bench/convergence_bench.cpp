@@ -0,0 +1,247 @@
+// Time-to-quality benchmark. Renders a high spp reference of every scene (cached as .pfm, so runs of
+// different builds compare against the same image), then renders it again with the current renderer
+// configuration and records RMSE and relMSE against the reference at every power of two spp, together
+// with the GPU time spent so far. The curve goes to a CSV, one row per checkpoint.
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "offscreen.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "texture.h"
+#include "image.h"
+#include "timing.h"
+
+struct Options
+{
+    std::vector<std::string> scenes = {"cube", "teapot", "dragon8k", "spheres", "instanced"};
+    unsigned int width = 160;
+    unsigned int height = 120;
+    uint32_t spp = 1;               // per dispatch
+    uint32_t maxSpp = 256;          // last checkpoint
+    uint32_t referenceSpp = 4096;   // reference noise has to stay well below the error at maxSpp
+    SamplerType samplerType = SamplerType::SOBOL;
+    std::string referenceDir = "references";
+    std::string label = "current"; // identifies the build or configuration in the CSV
+    std::string out = "convergence.csv";
+};
+
+struct Error
+{
+    double rmse;
+    double relMSE;
+};
+
+static constexpr float CAMERA_T = 0.125f;     // point on the orbit the scenes are viewed from
+static constexpr uint32_t REFERENCE_SEED = 0x9e3779b9u;
+static constexpr uint32_t REFERENCE_SPP = 16; // per dispatch
+static constexpr double REL_MSE_EPSILON = 1e-2; // keeps black pixels from dominating relMSE
+
+static std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--scenes")
+            options.scenes = split(value);
+        else if (arg == "--width")
+            options.width = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--height")
+            options.height = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--spp")
+            options.spp = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--max-spp")
+            options.maxSpp = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--reference-spp")
+            options.referenceSpp = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--reference-dir")
+            options.referenceDir = value;
+        else if (arg == "--sampler")
+        {
+            if (value == "pcg")
+                options.samplerType = SamplerType::PCG;
+            else if (value == "sobol")
+                options.samplerType = SamplerType::SOBOL;
+            else
+            {
+                std::cerr << "--sampler expects pcg or sobol" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--label")
+            options.label = value;
+        else if (arg == "--out")
+            options.out = value;
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    for (const std::string &name : options.scenes)
+    {
+        if (!findScene(name))
+        {
+            std::cerr << "Unknown scene " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static Error compare(const std::vector<float> &image, const std::vector<float> &reference)
+{
+    double squared = 0.0, relative = 0.0;
+    size_t values = 0;
+    for (size_t i = 0; i < image.size(); i += 4)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double error = double(image[i + c]) - reference[i + c];
+            squared += error * error;
+            relative += error * error / (double(reference[i + c]) * reference[i + c] + REL_MSE_EPSILON);
+            values++;
+        }
+    }
+    return Error{std::sqrt(squared / values), relative / values};
+}
+
+static bool renderReference(Renderer &renderer, const Camera &camera, const Options &options, const std::string &path, std::vector<float> &reference)
+{
+    unsigned int width, height;
+    if (readPFM(path, width, height, reference) && width == options.width && height == options.height)
+    {
+        std::cerr << "reference: " << path << " (cached)" << std::endl;
+        return true;
+    }
+
+    std::cerr << "reference: rendering " << path << std::endl;
+
+    // independent of the measured render: its own seed, and plain random sampling
+    renderer.seed = REFERENCE_SEED;
+    renderer.samplerType = SamplerType::PCG;
+    renderer.setSamplesPerPixel(std::min(REFERENCE_SPP, options.referenceSpp));
+    renderer.resetAccumulation();
+    while (renderer.sampleIndex < options.referenceSpp)
+    {
+        if (!renderer.trace(camera, false))
+            return false;
+        glFinish(); // keeps single submissions short for drivers with a watchdog
+    }
+
+    reference = readImageTexture(renderer.accumTex, options.width, options.height);
+    return writePFM(path, options.width, options.height, reference);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: convergence_bench [--scenes a,b,..] [--width n] [--height n] [--spp n] [--max-spp n] "
+                     "[--reference-spp n] [--reference-dir dir] [--sampler pcg|sobol] [--label name] [--out file.csv]"
+                  << std::endl;
+        return -1;
+    }
+
+    OffscreenContext context;
+    if (!context.create(options.width, options.height))
+        return -1;
+
+    std::error_code ec;
+    std::filesystem::create_directories(options.referenceDir, ec);
+
+    Renderer renderer(options.width, options.height);
+    renderer.reprojection = false;
+    renderer.denoiser.enabled = false;
+
+    FILE *csv = std::fopen(options.out.c_str(), "w");
+    if (!csv)
+    {
+        std::cerr << "Failed to write " << options.out << std::endl;
+        return -1;
+    }
+    std::fprintf(csv, "label,scene,spp,ms,rmse,relmse\n");
+
+    for (const std::string &name : options.scenes)
+    {
+        const SceneDesc &desc = *findScene(name);
+        Scene scene;
+        desc.build(scene);
+        if (!renderer.loadScene(scene))
+            return -1;
+
+        Camera camera = orbitCamera(desc, CAMERA_T);
+
+        std::ostringstream referencePath;
+        referencePath << options.referenceDir << "/" << name << "_" << options.width << "x" << options.height << "_" << options.referenceSpp << "spp.pfm";
+
+        std::vector<float> reference;
+        if (!renderReference(renderer, camera, options, referencePath.str(), reference))
+            return -1;
+
+        // -- Measured Render --
+        renderer.seed = 0;
+        renderer.samplerType = options.samplerType;
+        renderer.setSamplesPerPixel(options.spp);
+
+        // untimed frame so shader compilation and first touch costs stay out of the curve
+        renderer.resetAccumulation();
+        renderer.trace(camera, false);
+        glFinish();
+        renderer.resetAccumulation();
+
+        std::printf("%s, %s\n%8s %12s %14s %14s\n", name.c_str(), options.label.c_str(), "spp", "ms", "rmse", "relmse");
+
+        double ms = 0.0;
+        uint32_t checkpoint = 1;
+        while (renderer.sampleIndex < options.maxSpp)
+        {
+            auto start = std::chrono::steady_clock::now();
+            while (renderer.sampleIndex < checkpoint)
+                if (!renderer.trace(camera, false))
+                    return -1;
+            glFinish();
+            ms += msSince(start);
+
+            // readback and comparison aren't timed
+            Error error = compare(readImageTexture(renderer.accumTex, options.width, options.height), reference);
+            std::printf("%8u %12.2f %14.6e %14.6e\n", renderer.sampleIndex, ms, error.rmse, error.relMSE);
+            std::fprintf(csv, "%s,%s,%u,%.3f,%.9g,%.9g\n", options.label.c_str(), name.c_str(), renderer.sampleIndex, ms, error.rmse, error.relMSE);
+
+            checkpoint *= 2;
+        }
+        std::printf("\n");
+    }
+
+    std::fclose(csv);
+    return 0;
+}
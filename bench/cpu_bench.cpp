@@ -0,0 +1,218 @@
+// Microbenchmarks for the CPU side of scene loading: OBJ parsing, triangle conversion, BVH builds per
+// builder and leaf size, and BVH refits, over a range of triangle counts. Every case runs once untimed
+// and then --reps times, and is reported as mean, standard deviation, min and median. No GL context.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "object.h"
+#include "bvh.h"
+#include "timing.h"
+
+struct Stats
+{
+    double mean = 0.0, stddev = 0.0, min = 0.0, median = 0.0;
+};
+
+static size_t sink = 0; // results feed into this so the optimizer can't drop the timed work
+
+static Stats measure(int reps, const std::function<void()> &setup, const std::function<void()> &run)
+{
+    setup();
+    run(); // warmup
+
+    std::vector<double> ms;
+    for (int i = 0; i < reps; i++)
+    {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        ms.push_back(msSince(start));
+    }
+
+    Stats stats;
+    for (double value : ms)
+        stats.mean += value;
+    stats.mean /= ms.size();
+    for (double value : ms)
+        stats.stddev += (value - stats.mean) * (value - stats.mean);
+    stats.stddev = ms.size() > 1 ? std::sqrt(stats.stddev / (ms.size() - 1)) : 0.0;
+
+    std::sort(ms.begin(), ms.end());
+    stats.min = ms.front();
+    stats.median = ms[ms.size() / 2];
+    return stats;
+}
+
+static void printHeader(const char *title, const char *columns)
+{
+    std::printf("\n%s\n%s %10s %10s %10s %10s\n", title, columns, "mean ms", "stddev", "min", "median");
+}
+
+static void printStats(const Stats &stats)
+{
+    std::printf(" %10.3f %10.3f %10.3f %10.3f\n", stats.mean, stats.stddev, stats.min, stats.median);
+}
+
+// copies of one mesh on a grid until the scene has at least count triangles
+static void buildScene(const Mesh &mesh, size_t count, Scene &scene)
+{
+    size_t meshTriangles = std::max<size_t>(1, mesh.indices.size() / 3);
+    size_t copies = (count + meshTriangles - 1) / meshTriangles;
+    for (size_t i = 0; i < copies; i++)
+    {
+        Mesh copy = mesh;
+        copy.transform = Transform{{(i % 16) * 1.5f, 0.f, (i / 16) * 1.5f}, {0.f, 0.7f * i, 0.f}, glm::vec3(1.f)};
+        scene.meshes.push_back(copy);
+    }
+}
+
+static std::vector<size_t> parseCounts(const std::string &list)
+{
+    std::vector<size_t> counts;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            counts.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    return counts;
+}
+
+int main(int argc, char **argv)
+{
+    int reps = 10;
+    std::vector<size_t> counts = {1000, 8000, 64000, 256000};
+    const uint32_t leafSizes[] = {2, 4, 6, 8};
+    const char *models[] = {"assets/models/cube.obj", "assets/models/teapot.obj", "assets/models/dragon8k.obj"};
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg == "--reps")
+            reps = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--counts")
+            counts = parseCounts(argv[i + 1]);
+        else
+        {
+            std::fprintf(stderr, "usage: cpu_bench [--reps n] [--counts 1000,8000,...]\n");
+            return -1;
+        }
+    }
+
+    std::printf("%d reps per case\n", reps);
+
+    // -- OBJ Parsing --
+    printHeader("loadMesh", "model                          triangles");
+    for (const char *path : models)
+    {
+        std::vector<GPUMaterial> materials;
+        Mesh mesh{}; // attrib starts out null
+        Stats stats = measure(reps, [&]()
+                              { delete mesh.attrib; mesh = Mesh(); materials.clear(); },
+                              [&]()
+                              { mesh = loadMesh(path, GPUMaterial{}, Transform{}, materials); sink += mesh.indices.size(); });
+        std::printf("%-30s %10zu", path, mesh.indices.size() / 3);
+        printStats(stats);
+        delete mesh.attrib;
+    }
+
+    std::vector<GPUMaterial> materials;
+    Mesh dragon = loadMesh("assets/models/dragon8k.obj", GPUMaterial{}, Transform{}, materials);
+    if (dragon.indices.empty())
+        return -1;
+
+    // -- Triangle Conversion --
+    printHeader("convertToGPUMeshes (dragon8k copies)", " triangles     meshes");
+    for (size_t count : counts)
+    {
+        Scene scene;
+        buildScene(dragon, count, scene);
+
+        std::vector<GPUTriangle> triangles;
+        std::vector<GPUMesh> meshes;
+        Stats stats = measure(reps, []() {}, [&]()
+                              { convertToGPUMeshes(scene, triangles, meshes); sink += triangles.size(); });
+        std::printf("%10zu %10zu", triangles.size(), meshes.size());
+        printStats(stats);
+    }
+
+    // -- BVH Build --
+    printHeader("BVH build", " triangles builder     leaf      nodes   sah cost");
+    for (size_t count : counts)
+    {
+        Scene scene;
+        buildScene(dragon, count, scene);
+        std::vector<GPUTriangle> source;
+        std::vector<GPUMesh> meshes;
+        convertToGPUMeshes(scene, source, meshes);
+        source.resize(count);
+
+        for (int builder = BVH::MIDPOINT; builder <= BVH::BINNED_SAH; builder++)
+        {
+            for (uint32_t leaf : leafSizes)
+            {
+                std::vector<GPUTriangle> triangles;
+                std::optional<BVH> bvh; // freed in the setup, outside the timing
+                Stats stats = measure(reps, [&]()
+                                      {
+                                          bvh.reset();
+                                          triangles = source;
+                                      },
+                                      [&]()
+                                      {
+                                          bvh.emplace(triangles, static_cast<BVH::Builder>(builder), leaf);
+                                          sink += bvh->nodes.size();
+                                      });
+
+                // a whole tree walk, not part of the build
+                size_t nodes = bvh->nodes.size();
+                float sah = bvh->sahCost();
+                std::printf("%10zu %-10s %6u %10zu %10.1f", count, builder == BVH::MIDPOINT ? "midpoint" : "sah", leaf, nodes, sah);
+                printStats(stats);
+            }
+        }
+    }
+
+    // -- BVH Refit --
+    printHeader("BVH refit (after moving every vertex)", " triangles      nodes");
+    for (size_t count : counts)
+    {
+        Scene scene;
+        buildScene(dragon, count, scene);
+        std::vector<GPUTriangle> triangles;
+        std::vector<GPUMesh> meshes;
+        convertToGPUMeshes(scene, triangles, meshes);
+        triangles.resize(count);
+
+        BVH bvh(triangles);
+        int frame = 0;
+        Stats stats = measure(reps, [&]()
+                              {
+                                  // a small wobble, like one frame of animation
+                                  frame++;
+                                  for (GPUTriangle &tri : bvh.triangles)
+                                  {
+                                      glm::vec3 offset(0.01f * std::sin(frame + tri.a.x), 0.f, 0.f);
+                                      tri.a += offset;
+                                      tri.b += offset;
+                                      tri.c += offset;
+                                  }
+                              },
+                              [&]()
+                              { bvh.refit(); sink += bvh.nodes.size(); });
+        std::printf("%10zu %10zu", count, bvh.nodes.size());
+        printStats(stats);
+    }
+
+    delete dragon.attrib;
+    std::printf("\n(checksum %zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Rays per second of the CPU backend's tile kernels (cputracer.h): the generic kernel, which looks up
+// the scene's features per ray, against the one specialized for each scene. Every scene is traced
+// from the start of its orbit, a whole frame per rep. The two images are compared pixel by pixel,
+// they only may differ in diffuse-only scenes, whose kernel doesn't renormalize bounce directions
+// (like the shader's DIFFUSE_ONLY variant). No GL context.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cputracer.h"
+#include "scenes.h"
+#include "timing.h"
+
+struct Options
+{
+    std::string scene; // empty = all
+    unsigned int width = 320;
+    unsigned int height = 240;
+    uint32_t spp = 4;
+    uint32_t bounces = 5;
+    unsigned int threads = 1;
+    int reps = 3;
+};
+
+struct Result
+{
+    double bestMs = 1e30;
+    uint64_t rays = 0; // per frame
+    std::string kernel;
+    std::vector<glm::vec4> image;
+};
+
+static Result measure(const Scene &scene, const Camera &camera, const Options &options, bool specialized)
+{
+    CPUTracer tracer(options.width, options.height, options.threads);
+    tracer.specializedKernels = specialized;
+    tracer.sceneData.maxBounce = options.bounces;
+    tracer.setSamplesPerPixel(options.spp);
+    tracer.loadScene(scene);
+
+    Result result;
+    for (int rep = -1; rep < options.reps; rep++) // rep -1 is the warmup
+    {
+        tracer.resetAccumulation();
+        tracer.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        tracer.trace(camera);
+        double ms = msSince(start);
+
+        if (rep >= 0)
+            result.bestMs = std::min(result.bestMs, ms);
+    }
+
+    for (unsigned int node = 0; node < NumaTopology::get().nodeCount(); node++)
+        result.rays += tracer.nodeRays(node);
+    result.kernel = tracer.kernelName;
+    result.image.assign(tracer.accum.data(), tracer.accum.data() + tracer.accum.size());
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene")
+            options.scene = argv[i + 1];
+        else if (arg == "--width")
+            options.width = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--height")
+            options.height = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--spp")
+            options.spp = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--bounces")
+            options.bounces = std::max(0, std::atoi(argv[i + 1]));
+        else if (arg == "--threads")
+            options.threads = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--reps")
+            options.reps = std::max(1, std::atoi(argv[i + 1]));
+        else
+        {
+            std::fprintf(stderr, "usage: kernel_bench [--scene name] [--width n] [--height n] [--spp n] [--bounces n] [--threads n] [--reps n]\n");
+            return -1;
+        }
+    }
+
+    std::printf("%ux%u, %u spp, %u bounces, best of %d reps, %u thread%s\n", options.width, options.height, options.spp,
+                options.bounces, options.reps, options.threads, options.threads > 1 ? "s" : "");
+    std::printf("\n%-10s %-48s %10s %12s %8s %10s\n", "Mrays/s", "specialized kernel", "generic", "specialized", "speedup", "differing");
+
+    for (const SceneDesc &desc : sceneRegistry())
+    {
+        if (!options.scene.empty() && options.scene != desc.name)
+            continue;
+
+        Scene scene;
+        desc.build(scene);
+        Camera camera = orbitCamera(desc, 0.0f);
+
+        Result generic = measure(scene, camera, options, false);
+        Result specialized = measure(scene, camera, options, true);
+
+        size_t differing = 0;
+        for (size_t i = 0; i < generic.image.size(); i++)
+            if (generic.image[i] != specialized.image[i])
+                differing++;
+
+        double genericRate = generic.rays / (generic.bestMs * 1e3);
+        double specializedRate = specialized.rays / (specialized.bestMs * 1e3);
+        std::printf("%-10s %-48s %10.2f %12.2f %7.2fx %10zu\n", desc.name, specialized.kernel.c_str(), genericRate,
+                    specializedRate, generic.bestMs / specialized.bestMs, differing);
+    }
+
+    return 0;
+}
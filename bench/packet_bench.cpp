@@ -0,0 +1,334 @@
+// Ray throughput of the CPU ray kernels on one thread: the packets of packet.h for every ISA this CPU
+// supports, and single rays through the wide BVHs of widebvh.h. Rays follow the scene's orbit: camera
+// rays through every pixel in the 4x4 pixel packets the CPU backend traces, shadow rays from where
+// those hit towards the scene's light, which are just as coherent, and diffuse bounces from the same
+// hits, which aren't. All only look for the closest triangle, spheres are left out. Every kernel's
+// hits are checked against the scalar traversal. No GL context.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "packet.h"
+#include "scenes.h"
+#include "widebvh.h"
+#include "timing.h"
+
+struct Options
+{
+    std::string scene = "dragon8k";
+    unsigned int width = 640;
+    unsigned int height = 480;
+    uint32_t views = 8; // camera positions along the orbit
+    int reps = 5;
+};
+
+struct Result
+{
+    double bestMs = 1e30;
+    size_t mismatches = 0;
+};
+
+static const uint32_t BLOCK = 4;
+
+static void cameraPackets(const SceneDesc &desc, const Options &options, std::vector<RayPacket> &packets)
+{
+    glm::vec2 resolution(options.width, options.height);
+    for (uint32_t view = 0; view < options.views; view++)
+    {
+        // same rays as CPUTracer::traceTile
+        Camera camera = orbitCamera(desc, float(view) / options.views);
+        glm::vec3 forward = glm::normalize(camera.cameraFront);
+        glm::vec3 right = glm::normalize(glm::cross(forward, camera.cameraUp));
+        glm::vec3 up = glm::cross(right, forward);
+
+        for (uint32_t by = 0; by < options.height; by += BLOCK)
+        {
+            for (uint32_t bx = 0; bx < options.width; bx += BLOCK)
+            {
+                RayPacket packet;
+                for (uint32_t y = by; y < std::min(by + BLOCK, options.height); y++)
+                {
+                    for (uint32_t x = bx; x < std::min(bx + BLOCK, options.width); x++)
+                    {
+                        glm::vec2 screen = (glm::vec2(x, y) + 0.5f) / resolution - 0.5f;
+                        screen.x *= resolution.x / resolution.y;
+                        glm::vec3 direction = glm::normalize(forward + screen.x * right + screen.y * up);
+
+                        uint32_t lane = packet.count++;
+                        packet.ox[lane] = camera.cameraPos.x;
+                        packet.oy[lane] = camera.cameraPos.y;
+                        packet.oz[lane] = camera.cameraPos.z;
+                        packet.dx[lane] = direction.x;
+                        packet.dy[lane] = direction.y;
+                        packet.dz[lane] = direction.z;
+                        packet.tMax[lane] = 1e30f;
+                    }
+                }
+                packets.push_back(packet);
+            }
+        }
+    }
+}
+
+// from the hits of traced camera packets towards the light, only rays that hit something
+static void shadowPackets(const std::vector<RayPacket> &camera, const BVH &bvh, const GPUSphere &light, std::vector<RayPacket> &packets)
+{
+    for (const RayPacket &hits : camera)
+    {
+        RayPacket packet;
+        for (uint32_t i = 0; i < hits.count; i++)
+        {
+            if (hits.triangle[i] == RayPacket::NO_HIT)
+                continue;
+
+            const GPUTriangle &tri = bvh.triangles[hits.triangle[i]];
+            glm::vec3 normal = glm::normalize(glm::cross(tri.b - tri.a, tri.c - tri.a));
+            glm::vec3 origin = glm::vec3(hits.ox[i], hits.oy[i], hits.oz[i]) +
+                               glm::vec3(hits.dx[i], hits.dy[i], hits.dz[i]) * hits.tMax[i] + normal * 0.0005f;
+            glm::vec3 toLight = light.position - origin;
+            float distance = glm::length(toLight);
+            glm::vec3 direction = toLight / distance;
+
+            uint32_t lane = packet.count++;
+            packet.ox[lane] = origin.x;
+            packet.oy[lane] = origin.y;
+            packet.oz[lane] = origin.z;
+            packet.dx[lane] = direction.x;
+            packet.dy[lane] = direction.y;
+            packet.dz[lane] = direction.z;
+            packet.tMax[lane] = distance - light.radius;
+        }
+        if (packet.count > 0)
+            packets.push_back(packet);
+    }
+}
+
+// cosine weighted bounces off the camera hits, packed 16 to a packet in pixel order
+static void diffusePackets(const std::vector<RayPacket> &camera, const BVH &bvh, std::vector<RayPacket> &packets)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (const RayPacket &hits : camera)
+    {
+        RayPacket packet;
+        for (uint32_t i = 0; i < hits.count; i++)
+        {
+            if (hits.triangle[i] == RayPacket::NO_HIT)
+                continue;
+
+            const GPUTriangle &tri = bvh.triangles[hits.triangle[i]];
+            glm::vec3 normal = glm::normalize(glm::cross(tri.b - tri.a, tri.c - tri.a));
+            glm::vec3 origin = glm::vec3(hits.ox[i], hits.oy[i], hits.oz[i]) +
+                               glm::vec3(hits.dx[i], hits.dy[i], hits.dz[i]) * hits.tMax[i] + normal * 0.0005f;
+
+            float r = std::sqrt(uniform(rng));
+            float theta = 2.0f * 3.1415926f * uniform(rng);
+            glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.1f ? glm::cross(glm::vec3(0, 1, 0), normal) : glm::cross(glm::vec3(1, 0, 0), normal));
+            glm::vec3 direction = glm::normalize(r * std::cos(theta) * tangent + r * std::sin(theta) * glm::cross(normal, tangent) +
+                                                 std::sqrt(std::max(0.0f, 1.0f - r * r)) * normal);
+
+            uint32_t lane = packet.count++;
+            packet.ox[lane] = origin.x;
+            packet.oy[lane] = origin.y;
+            packet.oz[lane] = origin.z;
+            packet.dx[lane] = direction.x;
+            packet.dy[lane] = direction.y;
+            packet.dz[lane] = direction.z;
+            packet.tMax[lane] = 1e30f;
+        }
+        if (packet.count > 0)
+            packets.push_back(packet);
+    }
+}
+
+// each ray of the packet on its own
+template <uint32_t W>
+static void traceWide(const WideBVH<W> &bvh, RayPacket &packet)
+{
+    typename WideBVH<W>::View view = bvh.view();
+    for (uint32_t i = 0; i < packet.count; i++)
+    {
+        float origin[3] = {packet.ox[i], packet.oy[i], packet.oz[i]};
+        float direction[3] = {packet.dx[i], packet.dy[i], packet.dz[i]};
+        intersectWide(view, origin, direction, packet.tMax[i], packet.triangle[i]);
+    }
+}
+
+static size_t rayCount(const std::vector<RayPacket> &packets)
+{
+    size_t rays = 0;
+    for (const RayPacket &packet : packets)
+        rays += packet.count;
+    return rays;
+}
+
+static Result measure(const std::function<void(RayPacket &)> &trace, const std::vector<RayPacket> &source,
+                      const std::vector<RayPacket> &reference, int reps)
+{
+    Result result;
+    std::vector<RayPacket> packets;
+
+    for (int rep = -1; rep < reps; rep++) // rep -1 is the warmup
+    {
+        packets = source;
+        auto start = std::chrono::steady_clock::now();
+        for (RayPacket &packet : packets)
+            trace(packet);
+        double ms = msSince(start);
+
+        if (rep < 0)
+            continue;
+        result.bestMs = std::min(result.bestMs, ms);
+    }
+
+    for (size_t p = 0; p < packets.size(); p++)
+    {
+        for (uint32_t i = 0; i < packets[p].count; i++)
+        {
+            const RayPacket &a = packets[p], &b = reference[p];
+            if (a.triangle[i] != b.triangle[i] || std::abs(a.tMax[i] - b.tMax[i]) > 1e-4f * std::max(1.0f, b.tMax[i]))
+                result.mismatches++;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene")
+            options.scene = argv[i + 1];
+        else if (arg == "--width")
+            options.width = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--height")
+            options.height = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--views")
+            options.views = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--reps")
+            options.reps = std::max(1, std::atoi(argv[i + 1]));
+        else
+        {
+            std::fprintf(stderr, "usage: packet_bench [--scene name] [--width n] [--height n] [--views n] [--reps n]\n");
+            return -1;
+        }
+    }
+
+    const SceneDesc *desc = findScene(options.scene);
+    if (!desc)
+    {
+        std::fprintf(stderr, "Unknown scene %s\n", options.scene.c_str());
+        return -1;
+    }
+
+    // -- Scene --
+    Scene scene;
+    desc->build(scene);
+    std::vector<GPUTriangle> triangles;
+    std::vector<GPUMesh> meshes;
+    convertToGPUMeshes(scene, triangles, meshes);
+    if (triangles.empty())
+        return -1;
+    BVH bvh(triangles, BVH::BINNED_SAH);
+    BVHView view{bvh.nodes.data(), bvh.triangles.data()};
+
+    // brightest sphere, or a point above the target if none emits
+    GPUSphere light{glm::vec3(desc->target.x, desc->target.y + 10.0f, desc->target.z), 1.0f, glm::vec3(1.0f), 0.0f, glm::vec4(0.0f)};
+    float brightest = 0.0f;
+    for (const GPUSphere &sphere : scene.spheres)
+    {
+        if (sphere.emission.w > brightest)
+        {
+            brightest = sphere.emission.w;
+            light = sphere;
+        }
+    }
+
+    // -- Rays -- the scalar results are the reference, the other rays start at their hits
+    std::vector<RayPacket> rays[3], references[3];
+    const char *rayNames[3] = {"camera", "shadow", "diffuse"};
+    cameraPackets(*desc, options, rays[0]);
+    references[0] = rays[0];
+    for (RayPacket &packet : references[0])
+        intersectPacket(ISA_SCALAR, view, packet);
+
+    shadowPackets(references[0], bvh, light, rays[1]);
+    diffusePackets(references[0], bvh, rays[2]);
+    for (int r = 1; r < 3; r++)
+    {
+        references[r] = rays[r];
+        for (RayPacket &packet : references[r])
+            intersectPacket(ISA_SCALAR, view, packet);
+    }
+
+    std::printf("%s: %zu triangles, %zu nodes, best of %d reps, 1 thread\n", desc->name, bvh.triangles.size(), bvh.nodes.size(), options.reps);
+    for (int r = 0; r < 3; r++)
+        std::printf("%zu %s rays\n", rayCount(rays[r]), rayNames[r]);
+
+    // -- Kernels --
+    struct Kernel
+    {
+        std::string name;
+        std::function<void(RayPacket &)> trace; // empty if not supported here
+    };
+    std::vector<Kernel> kernels;
+    for (int i = ISA_SCALAR; i < ISA_COUNT; i++)
+    {
+        PacketISA isa = static_cast<PacketISA>(i);
+        std::string name = i == ISA_SCALAR ? "scalar" : std::string("packet ") + packetISAName(isa) + " x" + std::to_string(packetWidth(isa));
+        if (packetISASupported(isa))
+            kernels.push_back({name, [&view, isa](RayPacket &packet)
+                               { intersectPacket(isa, view, packet); }});
+        else
+            kernels.push_back({name, nullptr});
+    }
+
+    WideBVH<4> wide4(bvh.nodes, bvh.triangles);
+    WideBVH<8> wide8(bvh.nodes, bvh.triangles);
+    bool hasWide4 = false, hasWide8 = false;
+    for (int i = ISA_SCALAR; i < ISA_COUNT; i++)
+    {
+        hasWide4 |= wideBVHWidth(static_cast<PacketISA>(i)) == 4;
+        hasWide8 |= wideBVHWidth(static_cast<PacketISA>(i)) == 8;
+    }
+    kernels.push_back({"wide x4 (" + std::to_string(wide4.nodes.size()) + " nodes)", nullptr});
+    if (hasWide4)
+        kernels.back().trace = [&wide4](RayPacket &packet)
+        { traceWide(wide4, packet); };
+    kernels.push_back({"wide x8 (" + std::to_string(wide8.nodes.size()) + " nodes)", nullptr});
+    if (hasWide8)
+        kernels.back().trace = [&wide8](RayPacket &packet)
+        { traceWide(wide8, packet); };
+
+    std::printf("\n%-24s %16s %16s %16s %11s\n", "Mrays/s", rayNames[0], rayNames[1], rayNames[2], "mismatches");
+    for (const Kernel &kernel : kernels)
+    {
+        std::printf("%-24s", kernel.name.c_str());
+        if (!kernel.trace)
+        {
+            std::printf(" %16s %16s %16s %11s\n", "-", "-", "-", "-");
+            continue;
+        }
+
+        size_t mismatches = 0;
+        for (int r = 0; r < 3; r++)
+        {
+            Result result = measure(kernel.trace, rays[r], references[r], options.reps);
+            mismatches += result.mismatches;
+            std::printf(" %16.2f", rayCount(rays[r]) / (result.bestMs * 1e3));
+        }
+        std::printf(" %11zu\n", mismatches);
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Queries per second of the RayQuery API (rayquery.h), closest hit and occlusion, in the order the
+// rays are given and sorted in batches of --batch rays. Rays are built from the scene's orbit: camera
+// rays through every pixel, shadow rays from their hits towards the light, short ambient occlusion
+// rays off the same hits, and all of those shuffled together. Streams are split evenly over the
+// threads, which all query the same RayQuery. Hits are checked against the scalar traversal. No GL
+// context.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rayquery.h"
+#include "scenes.h"
+#include "timing.h"
+
+struct Options
+{
+    std::string scene = "dragon8k";
+    unsigned int width = 640;
+    unsigned int height = 480;
+    uint32_t views = 4; // camera positions along the orbit
+    uint32_t aoRays = 4; // per camera hit
+    uint32_t batch = 65536; // reorderBatch of the sorted columns
+    unsigned int threads = 1;
+    int reps = 5;
+};
+
+static glm::vec3 cosineDirection(const glm::vec3 &normal, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    float r = std::sqrt(uniform(rng));
+    float theta = 2.0f * 3.1415926f * uniform(rng);
+    glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.1f ? glm::cross(glm::vec3(0, 1, 0), normal) : glm::cross(glm::vec3(1, 0, 0), normal));
+    return glm::normalize(r * std::cos(theta) * tangent + r * std::sin(theta) * glm::cross(normal, tangent) +
+                          std::sqrt(std::max(0.0f, 1.0f - r * r)) * normal);
+}
+
+static std::vector<QueryRay> cameraRays(const SceneDesc &desc, const Options &options)
+{
+    std::vector<QueryRay> rays;
+    glm::vec2 resolution(options.width, options.height);
+    for (uint32_t view = 0; view < options.views; view++)
+    {
+        Camera camera = orbitCamera(desc, float(view) / options.views);
+        glm::vec3 forward = glm::normalize(camera.cameraFront);
+        glm::vec3 right = glm::normalize(glm::cross(forward, camera.cameraUp));
+        glm::vec3 up = glm::cross(right, forward);
+
+        for (uint32_t y = 0; y < options.height; y++)
+        {
+            for (uint32_t x = 0; x < options.width; x++)
+            {
+                glm::vec2 screen = (glm::vec2(x, y) + 0.5f) / resolution - 0.5f;
+                screen.x *= resolution.x / resolution.y;
+                rays.push_back({camera.cameraPos, 1e30f, glm::normalize(forward + screen.x * right + screen.y * up), 0.0f});
+            }
+        }
+    }
+    return rays;
+}
+
+// calls query on count rays split evenly over the threads, best time of reps in ms
+static double measure(const std::function<void(size_t first, size_t count)> &query, size_t count, unsigned int threads, int reps)
+{
+    double best = 1e30;
+    for (int rep = -1; rep < reps; rep++) // rep -1 is the warmup
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned int t = 1; t < threads; t++)
+            workers.emplace_back(query, count * t / threads, count * (t + 1) / threads - count * t / threads);
+        query(0, count / threads);
+        for (std::thread &worker : workers)
+            worker.join();
+        double ms = msSince(start);
+
+        if (rep >= 0)
+            best = std::min(best, ms);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene")
+            options.scene = argv[i + 1];
+        else if (arg == "--width")
+            options.width = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--height")
+            options.height = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--views")
+            options.views = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--ao-rays")
+            options.aoRays = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--batch")
+            options.batch = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--threads")
+            options.threads = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--reps")
+            options.reps = std::max(1, std::atoi(argv[i + 1]));
+        else
+        {
+            std::fprintf(stderr, "usage: query_bench [--scene name] [--width n] [--height n] [--views n] [--ao-rays n] [--batch n] [--threads n] [--reps n]\n");
+            return -1;
+        }
+    }
+
+    const SceneDesc *desc = findScene(options.scene);
+    if (!desc)
+    {
+        std::fprintf(stderr, "Unknown scene %s\n", options.scene.c_str());
+        return -1;
+    }
+
+    // -- Scene --
+    Scene scene;
+    desc->build(scene);
+    std::vector<GPUTriangle> triangles;
+    std::vector<GPUMesh> meshes;
+    convertToGPUMeshes(scene, triangles, meshes);
+    if (triangles.empty())
+        return -1;
+
+    RayQuery query(triangles);
+    RayQueryOptions scalarOptions;
+    scalarOptions.isa = ISA_SCALAR;
+    RayQuery reference(triangles, scalarOptions);
+
+    glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+    for (const GPUTriangle &tri : triangles)
+    {
+        boundsMin = glm::min(boundsMin, glm::min(tri.a, glm::min(tri.b, tri.c)));
+        boundsMax = glm::max(boundsMax, glm::max(tri.a, glm::max(tri.b, tri.c)));
+    }
+    float aoRadius = 0.1f * glm::length(boundsMax - boundsMin);
+
+    GPUSphere light{glm::vec3(desc->target.x, desc->target.y + 10.0f, desc->target.z), 1.0f, glm::vec3(1.0f), 0.0f, glm::vec4(0.0f)};
+    float brightest = 0.0f;
+    for (const GPUSphere &sphere : scene.spheres)
+    {
+        if (sphere.emission.w > brightest)
+        {
+            brightest = sphere.emission.w;
+            light = sphere;
+        }
+    }
+
+    // -- Rays --
+    const int SETS = 4;
+    const char *setNames[SETS] = {"camera", "shadow", "ao", "shuffled"};
+    std::vector<QueryRay> rays[SETS];
+    rays[0] = cameraRays(*desc, options);
+    std::vector<QueryHit> cameraHits = reference.closestHit(rays[0]);
+
+    std::mt19937 rng(1234);
+    for (size_t i = 0; i < rays[0].size(); i++)
+    {
+        const QueryHit &hit = cameraHits[i];
+        if (hit.primitive == RayQuery::MISS)
+            continue;
+
+        const GPUTriangle &tri = triangles[hit.primitive];
+        glm::vec3 normal = glm::normalize(glm::cross(tri.b - tri.a, tri.c - tri.a));
+        if (glm::dot(normal, rays[0][i].direction) > 0.0f)
+            normal = -normal; // the back was hit
+        glm::vec3 origin = rays[0][i].origin + rays[0][i].direction * hit.distance + normal * 0.0005f;
+
+        glm::vec3 toLight = light.position - origin;
+        float distance = glm::length(toLight);
+        rays[1].push_back({origin, distance - light.radius, toLight / distance, 0.0f});
+
+        for (uint32_t a = 0; a < options.aoRays; a++)
+            rays[2].push_back({origin, aoRadius, cosineDirection(normal, rng), 0.0f});
+    }
+    for (int s = 0; s < 3; s++)
+        rays[3].insert(rays[3].end(), rays[s].begin(), rays[s].end());
+    std::shuffle(rays[3].begin(), rays[3].end(), rng);
+
+    std::printf("%s: %zu triangles (two sided), built in %.1f ms, best of %d reps, %u thread%s\n", desc->name,
+                query.primitiveCount(), query.buildMs, options.reps, options.threads, options.threads > 1 ? "s" : "");
+    for (int s = 0; s < SETS; s++)
+        std::printf("%zu %s rays\n", rays[s].size(), setNames[s]);
+
+    // -- Queries --
+    RayQueryOptions sortOptions;
+    sortOptions.reorderBatch = options.batch;
+    RayQuery sorted(triangles, sortOptions);
+
+    std::printf("\n%-10s %14s %14s %14s %14s %11s\n", "Mqueries/s", "closest", "closest sort", "occluded", "occluded sort", "mismatches");
+    for (int s = 0; s < SETS; s++)
+    {
+        const std::vector<QueryRay> &set = rays[s];
+        std::vector<QueryHit> hits(set.size());
+        std::vector<uint8_t> occluded(set.size());
+        std::printf("%-10s", setNames[s]);
+
+        for (const RayQuery *q : {&query, &sorted})
+        {
+            double ms = measure([&](size_t first, size_t count)
+                                { q->closestHit(set.data() + first, hits.data() + first, count); },
+                                set.size(), options.threads, options.reps);
+            std::printf(" %14.2f", set.size() / (ms * 1e3));
+        }
+        for (const RayQuery *q : {&query, &sorted})
+        {
+            double ms = measure([&](size_t first, size_t count)
+                                { q->occluded(set.data() + first, occluded.data() + first, count); },
+                                set.size(), options.threads, options.reps);
+            std::printf(" %14.2f", set.size() / (ms * 1e3));
+        }
+
+        // the last closest hits and occlusions were sorted, both against the scalar closest hits
+        std::vector<QueryHit> expected = reference.closestHit(set);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < set.size(); i++)
+        {
+            const QueryHit &a = hits[i], &b = expected[i];
+            if (a.primitive != b.primitive || std::abs(a.distance - b.distance) > 1e-4f * std::max(1.0f, b.distance) ||
+                std::abs(a.u - b.u) > 1e-4f || std::abs(a.v - b.v) > 1e-4f || occluded[i] != (b.primitive != RayQuery::MISS))
+                mismatches++;
+        }
+        std::printf(" %11zu\n", mismatches);
+    }
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+// End-to-end benchmark of the GPU path tracer. Renders the canned scenes of scenes.cpp along their
+// orbit camera paths at a fixed resolution and spp and prints load, BVH build and upload times,
+// Mrays/s and frame time percentiles as JSON. Uses an offscreen context (offscreen.h), so it runs on
+// software GL (llvmpipe) without a GPU or display, e.g. `LIBGL_ALWAYS_SOFTWARE=1 ./raytracer_bench`.
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "offscreen.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "timing.h"
+
+struct Options
+{
+    std::vector<std::string> scenes = {"cube", "teapot", "dragon8k", "spheres", "instanced"};
+    unsigned int width = 320;
+    unsigned int height = 240;
+    uint32_t spp = 1;
+    uint32_t frames = 60; // one full orbit
+    uint32_t warmup = 3;  // untimed frames before the orbit, shader compilation and driver warmup
+    std::string out;      // empty = stdout
+};
+
+struct FrameStats
+{
+    double mean = 0.0, min = 0.0, max = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0;
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    size_t n = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+static FrameStats frameStats(const std::vector<double> &ms)
+{
+    FrameStats stats;
+    if (ms.empty())
+        return stats;
+
+    for (double value : ms)
+        stats.mean += value;
+    stats.mean /= ms.size();
+    stats.min = *std::min_element(ms.begin(), ms.end());
+    stats.max = *std::max_element(ms.begin(), ms.end());
+    stats.p50 = percentile(ms, 0.50);
+    stats.p95 = percentile(ms, 0.95);
+    stats.p99 = percentile(ms, 0.99);
+    return stats;
+}
+
+static std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string escaped = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--scenes")
+            options.scenes = split(value);
+        else if (arg == "--width")
+            options.width = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--height")
+            options.height = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--spp")
+            options.spp = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--frames")
+            options.frames = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--warmup")
+            options.warmup = std::max(0, std::atoi(value.c_str()));
+        else if (arg == "--out")
+            options.out = value;
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    for (const std::string &name : options.scenes)
+    {
+        if (!findScene(name))
+        {
+            std::cerr << "Unknown scene " << name << ", available:";
+            for (const SceneDesc &desc : sceneRegistry())
+                std::cerr << " " << desc.name;
+            std::cerr << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: raytracer_bench [--scenes a,b,..] [--width n] [--height n] [--spp n] [--frames n] [--warmup n] [--out file.json]" << std::endl;
+        return -1;
+    }
+
+    OffscreenContext context;
+    if (!context.create(options.width, options.height))
+        return -1;
+
+    Renderer renderer(options.width, options.height);
+    renderer.denoiser.enabled = false; // only the path tracer is measured
+    renderer.setSamplesPerPixel(options.spp);
+
+    std::string device = std::string((const char *)glGetString(GL_VENDOR)) + " " + (const char *)glGetString(GL_RENDERER);
+
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"device\": " << jsonString(device) << ",\n";
+    json << "  \"width\": " << options.width << ",\n";
+    json << "  \"height\": " << options.height << ",\n";
+    json << "  \"spp\": " << options.spp << ",\n";
+    json << "  \"frames\": " << options.frames << ",\n";
+    json << "  \"scenes\": [";
+
+    for (size_t s = 0; s < options.scenes.size(); s++)
+    {
+        const SceneDesc &desc = *findScene(options.scenes[s]);
+        std::cerr << "bench: " << desc.name << std::endl;
+
+        // -- Load --
+        auto start = std::chrono::steady_clock::now();
+        Scene scene;
+        desc.build(scene);
+        double buildMs = msSince(start);
+
+        if (!renderer.loadScene(scene))
+            return -1;
+
+        // -- Camera Path --
+        for (uint32_t i = 0; i < options.warmup; i++)
+            renderer.trace(orbitCamera(desc, 0.0f), true);
+        glFinish();
+
+        std::vector<double> frameMs;
+        frameMs.reserve(options.frames);
+        for (uint32_t frame = 0; frame < options.frames; frame++)
+        {
+            Camera camera = orbitCamera(desc, float(frame) / options.frames);
+
+            // timer queries are read back right away, the pipeline stall doesn't matter here
+            auto frameStart = std::chrono::steady_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            if (!renderer.trace(camera, true))
+                return -1;
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            double cpuMs = msSince(frameStart);
+
+            // some software drivers report a constant 1ns, fall back to the cpu clock (the query result waited for the gpu)
+            frameMs.push_back(ns > 1 ? ns / 1e6 : cpuMs);
+        }
+
+        FrameStats stats = frameStats(frameMs);
+
+        // camera rays, counted like GPUProfiler::megaRaysPerSecond
+        double totalMs = stats.mean * frameMs.size();
+        double rays = double(options.width) * options.height * options.spp * frameMs.size();
+        double megaRaysPerSecond = totalMs > 0.0 ? rays / (totalMs * 1e3) : 0.0;
+
+        char buffer[1024];
+        std::snprintf(buffer, sizeof(buffer),
+                      "%s\n    {\n"
+                      "      \"name\": \"%s\",\n"
+                      "      \"triangles\": %zu,\n"
+                      "      \"bvh_nodes\": %zu,\n"
+                      "      \"spheres\": %zu,\n"
+                      "      \"load_ms\": %.3f,\n"
+                      "      \"bvh_build_ms\": %.3f,\n"
+                      "      \"upload_ms\": %.3f,\n"
+                      "      \"mrays_per_s\": %.3f,\n"
+                      "      \"frame_ms\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f}\n"
+                      "    }",
+                      s == 0 ? "" : ",", desc.name, renderer.triangleCount, renderer.nodeCount, scene.spheres.size(),
+                      buildMs + renderer.convertMs, renderer.bvhMs, renderer.uploadMs, megaRaysPerSecond,
+                      stats.mean, stats.min, stats.max, stats.p50, stats.p95, stats.p99);
+        json << buffer;
+    }
+    json << "\n  ]\n}\n";
+
+    glDeleteQueries(1, &query);
+
+    if (options.out.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        FILE *file = std::fopen(options.out.c_str(), "w");
+        if (!file)
+        {
+            std::cerr << "Failed to write " << options.out << std::endl;
+            return -1;
+        }
+        std::fputs(json.str().c_str(), file);
+        std::fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Compares the convergence of the PCG and Sobol samplers used by raytracer.comp.
+// Integrates known functions over the cosine-weighted hemisphere the way trace() draws bounces,
+// and prints the RMSE across many pixels for every power of two samples per pixel.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "sampler.h"
+
+struct Direction
+{
+    float x, y, z;
+};
+
+// same mapping as cosineHemisphereDirection(), expressed in the local frame of the normal
+static Direction cosineHemisphere(float u1, float u2)
+{
+    float r = std::sqrt(u1);
+    float theta = 2.0f * 3.1415926f * u2;
+    return {r * std::cos(theta), r * std::sin(theta), std::sqrt(1.0f - u1)};
+}
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr float EDGE = 0.25f;
+
+// hard shadow edge: projected disk area right of x = EDGE
+static float edge(const Direction &d) { return d.x > EDGE ? 1.0f : 0.0f; }
+static double edgeReference() { return (std::acos(EDGE) - EDGE * std::sqrt(1.0 - EDGE * EDGE)) / PI; }
+
+// smooth lobe: mean of (1 + x)^2 over the unit disk
+static float lobe(const Direction &d) { return (1.0f + d.x) * (1.0f + d.x); }
+static double lobeReference() { return 1.25; }
+
+struct Integrand
+{
+    const char *name;
+    int bounces;
+    double reference;
+    float (*evaluate)(const Direction *dirs);
+};
+
+static const Integrand integrands[] = {
+    {"edge (2D, discontinuous)", 1, edgeReference(), [](const Direction *d) { return edge(d[0]); }},
+    {"lobe (2D, smooth)", 1, lobeReference(), [](const Direction *d) { return lobe(d[0]); }},
+    {"edge x lobe (2 bounces)", 2, edgeReference() * lobeReference(), [](const Direction *d) { return edge(d[0]) * lobe(d[1]); }},
+};
+
+static double rmse(const Integrand &integrand, SamplerType type, uint32_t spp, uint32_t pixels, const std::vector<uint32_t> &matrices)
+{
+    double squaredError = 0.0;
+
+    for (uint32_t pixel = 0; pixel < pixels; pixel++)
+    {
+        Sampler sampler{type, matrices.data(), integerHash(pixel ^ integerHash(0)), 0, integerHash(pixel)};
+
+        double sum = 0.0;
+        for (uint32_t i = 0; i < spp; i++)
+        {
+            sampler.index = i;
+
+            Direction dirs[2];
+            for (int bounce = 0; bounce < integrand.bounces; bounce++)
+            {
+                uint32_t dimension = bounce * DIMS_PER_BOUNCE + DIM_HEMISPHERE;
+                float u1 = sampler.sample(dimension);
+                float u2 = sampler.sample(dimension + 1);
+                dirs[bounce] = cosineHemisphere(u1, u2);
+            }
+
+            sum += integrand.evaluate(dirs);
+        }
+
+        double error = sum / spp - integrand.reference;
+        squaredError += error * error;
+    }
+
+    return std::sqrt(squaredError / pixels);
+}
+
+int main()
+{
+    constexpr uint32_t pixels = 4096;
+    constexpr uint32_t maxSpp = 1024;
+
+    std::vector<uint32_t> matrices = buildSobolMatrices();
+
+    for (const Integrand &integrand : integrands)
+    {
+        std::printf("%s, reference %.6f\n", integrand.name, integrand.reference);
+        std::printf("%8s %14s %14s %10s\n", "spp", "rmse pcg", "rmse sobol", "ratio");
+
+        double firstPcg = 0.0, firstSobol = 0.0, lastPcg = 0.0, lastSobol = 0.0;
+        for (uint32_t spp = 1; spp <= maxSpp; spp *= 2)
+        {
+            double pcg = rmse(integrand, SamplerType::PCG, spp, pixels, matrices);
+            double sobol = rmse(integrand, SamplerType::SOBOL, spp, pixels, matrices);
+            std::printf("%8u %14.6e %14.6e %10.2f\n", spp, pcg, sobol, pcg / sobol);
+
+            if (spp == 1)
+            {
+                firstPcg = pcg;
+                firstSobol = sobol;
+            }
+            lastPcg = pcg;
+            lastSobol = sobol;
+        }
+
+        // rmse ~ spp^slope, plain Monte Carlo converges at -0.5
+        double octaves = std::log2(double(maxSpp));
+        std::printf("convergence slope: pcg %.2f, sobol %.2f\n\n",
+                    std::log2(lastPcg / firstPcg) / octaves,
+                    std::log2(lastSobol / firstSobol) / octaves);
+    }
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "permutations.h"
+
+// Work group shape of the raytracer, injected as LOCAL_SIZE_X / LOCAL_SIZE_Y.
+struct WorkGroupSize
+{
+    uint32_t x = 16;
+    uint32_t y = 16;
+
+    std::vector<std::string> defines() const;
+};
+
+// Times every candidate shape on the current scene and keeps the fastest one per device and scene class.
+class Autotuner
+{
+public:
+    static constexpr const char *CACHE_PATH = "autotune.cache"; // "device \t scene class \t x \t y \t ms" per line
+    static constexpr int WARMUP_DISPATCHES = 2;
+
+    int timedDispatches = 8; // per candidate, the median is kept
+
+    Autotuner(const RaytracerFeatures &features, size_t triangleCount);
+
+    // Looks up a previous result for this device and scene class.
+    bool load(WorkGroupSize &out) const;
+    void save(const WorkGroupSize &size, double ms) const;
+
+    // Compiles and times every candidate. setUniforms is called after glUseProgram, before the dispatches.
+    WorkGroupSize run(ShaderPermutations &permutations, unsigned int width, unsigned int height,
+                      const std::function<void(const Shader &)> &setUniforms, double &bestMs);
+
+private:
+    RaytracerFeatures features;
+    std::string device;     // GL_VENDOR + GL_RENDERER
+    std::string sceneClass; // feature defines + triangle count order of magnitude
+};
+
+#endif
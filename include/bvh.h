@@ -11,6 +11,13 @@ struct BVH
 {
     static constexpr size_t MAX_DEPTH = 20;
     static constexpr size_t LEAF_TRIANGLES = 6;
+    static constexpr uint32_t SAH_BINS = 16;
+
+    enum Builder
+    {
+        MIDPOINT,   // splits the longest axis in half
+        BINNED_SAH, // surface area heuristic evaluated at SAH_BINS centroid bins per axis
+    };
 
     struct GPUNode
     {
@@ -25,11 +32,26 @@ struct BVH
     std::vector<GPUNode> nodes;
     std::vector<GPUTriangle> triangles;
 
-    BVH(std::vector<GPUTriangle> &triangles);
+    Builder builder;
+    uint32_t leafTriangles; // nodes with at most this many triangles aren't split
+
+    BVH(std::vector<GPUTriangle> &triangles, Builder builder = MIDPOINT, uint32_t leafTriangles = LEAF_TRIANGLES);
 
     void split(const uint32_t nodeIndex, const int depth = 0);
+
+    // Recomputes every bound from the current triangles and keeps the topology,
+    // for animated meshes whose triangles moved but didn't change order.
+    void refit();
+
+    // Expected traversal cost relative to the root, lower is a better tree (SAH with unit costs).
+    float sahCost() const;
+
     void growToInclude(GPUNode &node, const glm::vec3 point);
     void growToInclude(GPUNode &node, const GPUTriangle &triangle);
+
+private:
+    // split position along axis, false if a leaf is cheaper
+    bool findSAHSplit(const GPUNode &node, int &axis, float &splitPos) const;
 };
 
 #endif
\ No newline at end of file
@@ -6,6 +6,18 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// CameraData uniform block of raytracer.comp, std140 pads every vec3 to 16 bytes
+struct GPUCameraData
+{
+    glm::vec4 cameraPos;
+    glm::vec4 cameraFront;
+    glm::vec4 cameraUp;
+
+    glm::vec4 prevCameraPos;
+    glm::vec4 prevCameraFront;
+    glm::vec4 prevCameraUp;
+};
+
 struct Camera
 {
     float fov, speed, yaw, pitch;
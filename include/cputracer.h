@@ -0,0 +1,199 @@
+#ifndef CPUTRACER_H
+#define CPUTRACER_H
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "object.h"
+#include "bvh.h"
+#include "numa.h"
+#include "packet.h"
+#include "permutations.h"
+#include "sampler.h"
+#include "tilescheduler.h"
+#include "widebvh.h"
+
+// CPU backend, a C++ mirror of raytracer.comp. Traces the same scene data with the same trace(),
+// samplers and accumulation across all cores in tiles, handed out by a work stealing TileScheduler.
+// Renders where GL 4.3 isn't available and serves as a reference to validate GPU output against:
+// with equal seeds the PCG and Sobol sequences match the shader's exactly, so only float rounding
+// differs. Camera rays are traced as packets of PACKET_BLOCK x PACKET_BLOCK pixels (see packet.h),
+// the bounces after them one ray at a time through a 4 or 8 wide copy of the BVH (see widebvh.h).
+// On NUMA machines the read-only scene data can be replicated per node or interleaved (see numa.h).
+// Like the raytracer's permutations, the tile kernel is compiled per scene feature set and the one
+// matching the loaded scene is picked, see Kernel.
+class CPUTracer
+{
+public:
+    static constexpr unsigned int PACKET_BLOCK = 4; // 16 camera rays per packet
+
+    // -- Settings --
+    GPUSceneData sceneData{5, 1}; // maxBounce, numRaysPerPixel
+    SamplerType samplerType = SamplerType::SOBOL;
+    uint32_t seed = 0;
+    unsigned int threadCount; // 0 in the constructor = one per hardware thread
+    unsigned int tileSize = 16; // pixels per side, a multiple of PACKET_BLOCK keeps packets full
+    PacketISA packetISA = bestPacketISA(); // packets and wide BVH, ISA_SCALAR traces like the shader
+
+    // -- Memory -- of the scene data the workers read, applied by loadScene
+    Placement placement = PLACE_LOCAL;
+    bool hugePages = true;   // BVH and triangle arrays of 2MB and up
+    bool pinThreads = false; // worker i to NumaTopology::spreadCpus()[i]
+
+    // -- Kernels --
+    bool specializedKernels = true; // false runs the generic kernel, which checks every feature per ray
+    RaytracerFeatures features;     // of the loaded scene
+    std::string kernelName;         // of the last trace
+
+    // -- Load Timings -- (of the last loadScene)
+    double convertMs = 0.0;
+    double bvhMs = 0.0;
+    double wideMs = 0.0; // collapsing the BVH for wideBVHWidth(packetISA)
+    size_t triangleCount = 0;
+    size_t nodeCount = 0;
+
+    uint32_t frameIndex = 0;  // frames since the accumulation was reset
+    uint32_t sampleIndex = 0; // samples per pixel accumulated since then
+
+    TileScheduler scheduler; // per thread tiles, steals and utilization since resetStats
+
+    const unsigned int width, height;
+
+    // Same layout as accumTex: rgb = mean, a = sample count, rows bottom to top. Pages are first
+    // written by the workers tracing the tiles on them, so they end up on those workers' nodes.
+    PlacedArray<glm::vec4> accum;
+
+    CPUTracer(unsigned int width, unsigned int height, unsigned int threads = 0);
+
+    void loadScene(const Scene &scene, BVH::Builder builder = BVH::BINNED_SAH);
+
+    void setSamplesPerPixel(uint32_t samples) { sceneData.numRaysPerPixel = samples; }
+    void resetAccumulation(uint32_t firstSample = 0); // see Renderer::resetAccumulation
+
+    // Adds numRaysPerPixel samples seen from camera to the accumulation, like one raytracer dispatch.
+    void trace(const Camera &camera);
+
+    // Same for rows [firstRow, lastRow) only, the rest of the accumulation is left as it is. Counts
+    // as a whole dispatch, so the sample sequence stays in step with the raytracer's other rows.
+    void trace(const Camera &camera, uint32_t firstRow, uint32_t lastRow);
+
+    // -- Stats -- rays counted per NUMA node of the thread that traced them, since resetStats
+    uint64_t nodeRays(unsigned int node) const;
+    double nodeMegaRaysPerSecond(unsigned int node) const; // over the scheduler's wall time
+    void resetStats();
+    void printStats() const; // per thread, then per node
+
+private:
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        glm::vec3 invDir;
+    };
+
+    struct Collision
+    {
+        bool didHit = false;
+        float distance = 1e30f;
+        glm::vec3 hitPoint;
+        glm::vec3 normal;
+        const GPUMaterial *material = nullptr;
+    };
+
+    std::vector<GPUMaterial> materials;
+    std::vector<GPUMaterial> sphereMaterials; // spheres store their material inline
+    std::vector<GPUSphere> spheres;
+    std::vector<GPUTriangle> triangles; // in BVH leaf order
+    std::vector<BVH::GPUNode> nodes;
+    std::vector<uint32_t> sobolMatrices;
+
+    // only the one matching packetISA is built
+    WideBVH<4> wide4;
+    WideBVH<8> wide8;
+    uint32_t wideWidth = 0;
+
+    template <uint32_t W>
+    struct WideCopy
+    {
+        PlacedArray<typename WideBVH<W>::Node> nodes;
+        PlacedArray<typename WideBVH<W>::TriangleBlock> blocks;
+        PlacedArray<typename WideBVH<W>::Leaf> leaves;
+
+        typename WideBVH<W>::View view() const { return {nodes.empty() ? nullptr : nodes.data(), blocks.data(), leaves.data()}; }
+    };
+
+    // what traceTile reads, the vectors above are only the source of these
+    struct SceneCopy
+    {
+        PlacedArray<BVH::GPUNode> nodes;
+        PlacedArray<GPUTriangle> triangles;
+        WideCopy<4> wide4;
+        WideCopy<8> wide8;
+    };
+    std::vector<SceneCopy> copies; // one per node with PLACE_REPLICATE
+    Placement placedAs = PLACE_LOCAL;
+    bool placedHugePages = false;
+
+    struct alignas(64) NodeCounters
+    {
+        std::atomic<uint64_t> rays{0};
+    };
+    std::unique_ptr<NodeCounters[]> nodeCounters;
+
+    // How a kernel treats a scene feature: compiled out, compiled in, or looked up per ray.
+    enum KernelFeature
+    {
+        FEATURE_OFF,
+        FEATURE_ON,
+        FEATURE_RUNTIME
+    };
+    static constexpr uint32_t AT_RUNTIME = UINT32_MAX; // wide BVH width or bounce count read per ray
+    static constexpr uint32_t COMPILED_BOUNCES = 5;    // the default maxBounce, others loop to sceneData's
+
+    // Template argument of traceTile and what it calls. Each query folds to a constant unless its
+    // feature is left to runtime, so the kernels of a scene without spheres, say, don't test for them.
+    template <KernelFeature SPHERES, KernelFeature TRIANGLES, uint32_t WIDTH, KernelFeature SMOOTH, uint32_t BOUNCES>
+    struct Kernel
+    {
+        static bool spheres() { return SPHERES != FEATURE_OFF; } // at runtime the loop finds none
+        static bool triangles(const SceneCopy &scene)
+        {
+            return TRIANGLES == FEATURE_RUNTIME ? !scene.nodes.empty() && !scene.triangles.empty() : TRIANGLES == FEATURE_ON;
+        }
+        static uint32_t width(const CPUTracer &tracer) { return WIDTH == AT_RUNTIME ? tracer.wideWidth : WIDTH; }
+        static bool smooth() { return SMOOTH != FEATURE_OFF; } // off like DIFFUSE_ONLY in the shader
+        static uint32_t maxBounce(const CPUTracer &tracer) { return BOUNCES == AT_RUNTIME ? tracer.sceneData.maxBounce : BOUNCES; }
+    };
+    using GenericKernel = Kernel<FEATURE_RUNTIME, FEATURE_RUNTIME, AT_RUNTIME, FEATURE_RUNTIME, AT_RUNTIME>;
+
+    using TileKernel = void (CPUTracer::*)(uint32_t tile, uint32_t size, uint32_t firstRow, uint32_t lastRow, const Camera &camera);
+    TileKernel tileKernel = nullptr;
+
+    void selectKernel(); // from features, wideWidth and sceneData.maxBounce
+    template <KernelFeature SPHERES, KernelFeature TRIANGLES>
+    TileKernel selectWidth() const;
+    template <KernelFeature SPHERES, KernelFeature TRIANGLES, uint32_t WIDTH>
+    TileKernel selectSmooth() const;
+    template <KernelFeature SPHERES, KernelFeature TRIANGLES, uint32_t WIDTH, KernelFeature SMOOTH>
+    TileKernel selectBounces() const;
+
+    void buildWideBVH();
+    void placeScene();
+    template <class K>
+    void traceTile(uint32_t tile, uint32_t size, uint32_t firstRow, uint32_t lastRow, const Camera &camera);
+    template <class K>
+    glm::vec3 tracePath(const SceneCopy &scene, Ray ray, const Collision &primary, Sampler &sampler, uint64_t &rays) const;
+
+    template <class K>
+    Collision calculateRayCollision(const SceneCopy &scene, const Ray &ray) const;
+    void raySpheres(const Ray &ray, Collision &closest) const;
+    void rayBVH(const SceneCopy &scene, const Ray &ray, Collision &closest) const;
+    void triangleCollision(const SceneCopy &scene, const Ray &ray, uint32_t triangle, float distance, Collision &closest) const;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+// Edge-aware a-trous filter over the accumulated image, guided by the first hit g-buffer.
+class Denoiser
+{
+public:
+    static constexpr int MAX_ITERATIONS = 5; // step sizes 1..16, a 125px wide footprint
+
+    bool enabled = true;
+    int iterations = MAX_ITERATIONS;
+
+    float sigmaNormal = 128.0f;
+    float sigmaDepth = 0.05f;
+    float sigmaAlbedo = 0.1f;
+    float sigmaLuminance = 4.0f;
+
+    Denoiser(unsigned int width, unsigned int height);
+    ~Denoiser();
+
+    // Filters colorTex and returns the texture holding the result.
+    unsigned int apply(unsigned int colorTex, unsigned int depthTex, unsigned int normalTex, unsigned int albedoTex);
+
+private:
+    unsigned int width, height;
+    Shader shader;
+    unsigned int pingPong[2];
+};
+
+#endif
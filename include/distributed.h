@@ -0,0 +1,27 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+// Rendering one frame as many partial renders (image.h). Every sample depends only on its pixel and
+// its index (see Renderer::resetAccumulation), so renders of disjoint rows or sample ranges add up
+// to the render of all of them, whichever process or machine traced them.
+
+// Adds up partials of the same frame. False if their frame sizes differ or two of them overlap in
+// both rows and samples, which would count those samples twice.
+bool mergePartials(const std::vector<PartialImage> &partials, PartialImage &merged);
+
+// `engine --merge a.part b.part ... --out image.pfm [--out ...] [--partial merged.part]`, for partials
+// rendered anywhere with `engine --headless ... --rows a:b --samples a:b --partial f.part`.
+int runMerge(int argc, char **argv);
+
+// `engine --distribute 4 [--split rows|samples] [--ranges n] <--headless options> --out image.pfm`.
+// Cuts the frame into n ranges of rows (default) or samples, renders them with up to 4 local worker
+// processes at a time (`engine --headless` with --rows or --samples and --partial), retries a range
+// whose worker failed once and merges the partials into the outputs.
+int runCoordinator(int argc, char **argv);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef FRAMEBUDGET_H
+#define FRAMEBUDGET_H
+
+#include <cstdint>
+
+// Picks the samples per pixel and the number of raytracer dispatches per displayed frame
+// so that tracing fits in a frame time budget, from GPU timings of the previous frames (see GPUProfiler).
+class FrameBudget
+{
+public:
+    static constexpr uint32_t MAX_SAMPLES_PER_DISPATCH = 16; // longer dispatches hurt input latency and risk driver timeouts
+    static constexpr uint32_t MAX_DISPATCHES = 8;
+
+    bool enabled = true;
+    float targetFps = 60.0f;
+    float traceShare = 0.75f; // part of the frame given to the raytracer, the rest is for the denoiser and ui
+
+    uint32_t samplesPerPixel = 1; // per dispatch
+    uint32_t dispatches = 1;
+    float msPerSample = -1.0f; // smoothed cost of one sample over the whole image, < 0 until measured
+
+    // Feeds the trace time of a finished frame that took `samples` samples per pixel.
+    // cpuFrameMs stands in for drivers without a working timer query.
+    void addTiming(float traceMs, float cpuFrameMs, uint32_t samples);
+
+    // Picks the next frame's settings. Returns true if samplesPerPixel changed and has to be uploaded.
+    bool update();
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+
+// Batch rendering without a window, `engine --headless --scene dragon8k --spp 256 --out dragon.pfm`.
+// Renders straight into the accumulation texture (no display pass or ImGui) and writes it to disk.
+// Uses a surfaceless EGL context when built with EGL, which also works on Mesa's software rasterizer
+// on machines without a GPU or display, and falls back to a hidden GLFW window otherwise.
+// `--backend cpu` traces with CPUTracer instead and needs no GL at all.
+//
+// `--rows a:b` traces only rows [a, b) and `--samples a:b` only samples [a, b) of every pixel (in
+// place of --spp), and `--partial f.part` writes those as a partial render (image.h) for
+// `engine --merge`. This is what the workers of `engine --distribute` run, see distributed.h.
+int runHeadless(int argc, char **argv);
+
+// Frame size and samples per pixel without --width, --height and --spp.
+static constexpr unsigned int HEADLESS_WIDTH = 1440;
+static constexpr unsigned int HEADLESS_HEIGHT = 1080;
+static constexpr unsigned int HEADLESS_SPP = 256;
+
+// Samples per pixel of one dispatch, keeps single submissions short. Also the render server's.
+static constexpr uint32_t MAX_SPP_PER_DISPATCH = 16;
+
+// `x,y,z,yaw,pitch`, the value of --camera and of the render server's camera key.
+bool parseCamera(const std::string &value, glm::vec3 &position, float &yaw, float &pitch);
+
+#endif
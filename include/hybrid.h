@@ -0,0 +1,60 @@
+#ifndef HYBRID_H
+#define HYBRID_H
+
+#include <glad/glad.h>
+#include <cstdint>
+
+#include "camera.h"
+#include "cputracer.h"
+#include "renderer.h"
+
+// Renders one accumulation on both backends at once. The raytracer covers the bottom rows of
+// accumTex and the CPU backend the rows above, in whole CPU tile rows; the CPU rows are uploaded
+// into accumTex with glTexSubImage2D after each dispatch. Both take the same samples of a pixel as
+// either would alone, so it doesn't matter which one traced it. The split follows the rows per ms
+// each side managed, the GPU's measured with timestamp queries that are read a few frames late.
+class HybridTracer
+{
+public:
+    float smoothing = 0.25f; // weight of the newest throughput measurement
+
+    HybridTracer(Renderer &renderer, CPUTracer &cpu);
+    ~HybridTracer();
+
+    void setSamplesPerPixel(uint32_t samples);
+    void resetAccumulation();
+
+    // One dispatch on both. A moved camera restarts the accumulation, the CPU backend can't reproject.
+    bool trace(const Camera &camera, bool cameraMoved);
+
+    uint32_t cpuRows() const { return renderer.height - split; }
+    double gpuRowsPerMs() const { return gpuRate; }
+    double cpuRowsPerMs() const { return cpuRate; }
+    double cpuMs = 0.0; // last CPU share
+
+private:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    struct Timing
+    {
+        GLuint queries[2]; // timestamps before and after the dispatch
+        uint32_t rows;
+        bool pending;
+    };
+
+    Renderer &renderer;
+    CPUTracer &cpu;
+
+    uint32_t split; // first CPU row
+    Timing timings[FRAMES_IN_FLIGHT];
+    int current = 0;
+    double gpuRate = 0.0, cpuRate = 0.0; // rows per ms, 0 until measured
+
+    GLuint readFramebuffer = 0; // accumTex, to read back rows the CPU takes over
+
+    uint32_t tileRows() const;
+    void collectGPUTimings();
+    void rebalance();
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Float images as read back from the accumulation: RGBA, rows bottom to top (GL order).
+// The alpha channel isn't stored.
+
+// Portable float map, lossless HDR.
+bool writePFM(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba);
+bool readPFM(const std::string &path, unsigned int &width, unsigned int &height, std::vector<float> &rgba);
+
+// Radiance RGBE, HDR at a quarter of the size of a pfm.
+bool writeHDR(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba);
+
+// Binary 8 bit ppm, clamped to [0, 1] without tonemapping like the display pass.
+bool writePPM(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba);
+
+// Picks the format from the extension (.pfm, .hdr or .ppm).
+bool writeImage(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba);
+
+// -- Partial Renders -- rows [firstRow, lastRow) over samples [firstSample, lastSample) of a frame.
+// rgb is the sum of the samples' radiance and a their count, so partials of disjoint ranges merge
+// by adding them up (see distributed.h).
+struct PartialImage
+{
+    unsigned int width = 0, height = 0; // of the whole frame
+    unsigned int firstRow = 0, lastRow = 0;
+    uint32_t firstSample = 0, lastSample = 0;
+    std::vector<float> sums; // RGBA per pixel of the rows, bottom to top
+};
+
+// From an accumulation like accumTex, whose rgb is the mean of a samples.
+PartialImage partialFromAccumulation(unsigned int width, unsigned int height, const std::vector<float> &rgba,
+                                     unsigned int firstRow, unsigned int lastRow, uint32_t firstSample, uint32_t lastSample);
+
+// The whole frame as an accumulation again, rows the partial doesn't cover are black with no samples.
+std::vector<float> accumulationFromPartial(const PartialImage &partial);
+
+// A pfm-like header with the ranges, then the float RGBA in the byte order it gives.
+bool writePartial(const std::string &path, const PartialImage &partial);
+bool readPartial(const std::string &path, PartialImage &partial);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sampler.h"
+
+// One image for the render server, see server.h.
+struct RenderJob
+{
+    uint64_t id = 0;
+    std::string scene;
+    unsigned int width = 640;
+    unsigned int height = 480;
+    uint32_t spp = 64;
+    float orbit = 0.0f; // position on the scene's orbit, see orbitCamera
+    bool customCamera = false;
+    glm::vec3 position = glm::vec3(0);
+    float yaw = 0.0f, pitch = 0.0f;
+    SamplerType samplerType = SamplerType::SOBOL;
+    bool denoise = false;
+
+    int priority = 0; // higher goes first
+    std::chrono::steady_clock::time_point submitted;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // not started by then = dropped
+};
+
+struct RenderResult
+{
+    bool ok = false;
+    std::string error;
+    std::vector<float> pixels; // RGBA, rows bottom to top like image.h
+    double waitMs = 0.0;       // in the queue
+    double renderMs = 0.0;     // including loading the scene if it wasn't resident
+};
+
+// Jobs waiting for the render thread, taken highest priority first, then earliest deadline, then
+// in the order they were pushed. Thread safe, each job's result is handed back through its future.
+class JobQueue
+{
+public:
+    struct Entry
+    {
+        RenderJob job;
+        std::promise<RenderResult> result;
+        uint64_t order = 0;
+    };
+
+    // fails right away once the queue is closed
+    std::future<RenderResult> push(RenderJob job);
+
+    // Waits up to timeout for a job. False if none came or the queue is closed.
+    bool pop(Entry &entry, std::chrono::milliseconds timeout);
+
+    // Fails every queued job with reason, later pushes fail too.
+    void close(const std::string &reason);
+
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<Entry> heap;
+    uint64_t pushed = 0;
+    bool closed = false;
+    std::string closeReason;
+};
+
+#endif
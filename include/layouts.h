@@ -0,0 +1,28 @@
+#ifndef LAYOUTS_H
+#define LAYOUTS_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+// -- Bindings -- (must match the layout(binding = n) qualifiers in raytracer.comp)
+namespace Binding
+{
+    // shader storage blocks
+    constexpr GLuint SPHERES = 0;
+    constexpr GLuint MATERIALS = 1;
+    constexpr GLuint TRIANGLES = 2;
+    constexpr GLuint BVH_NODES = 3;
+    constexpr GLuint SCENE_DATA = 4;
+    constexpr GLuint SOBOL_MATRICES = 5;
+    constexpr GLuint TRAVERSAL_STATS = 6; // TRAVERSAL_STATS permutation only
+
+    // uniform blocks
+    constexpr GLuint CAMERA_DATA = 0;
+}
+
+// Checks the offsets, array strides and bindings of every struct uploaded to the raytracer
+// against the linked program, printing each mismatch. Returns false if any of them differ.
+bool verifyGPULayouts(const Shader &raytracer);
+
+#endif
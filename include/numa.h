@@ -0,0 +1,116 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// NUMA topology, memory placement and thread pinning for the CPU backend. Uses sysfs and the raw
+// syscalls on Linux, so there is no libnuma dependency. Everywhere else there is one node, memory
+// comes from the heap and pinning does nothing.
+
+enum Placement
+{
+    PLACE_LOCAL,      // one copy on the node of the thread that first touches it, the kernel default
+    PLACE_INTERLEAVE, // one copy with its pages spread round robin over all nodes
+    PLACE_REPLICATE,  // one copy per node, read by the threads running there
+};
+
+const char *placementName(Placement placement);
+
+struct NumaTopology
+{
+    std::vector<std::vector<unsigned int>> nodeCpus; // online cpus of each node
+    std::vector<int> cpuNode;                        // node of each cpu id, -1 if offline
+
+    // read from /sys once
+    static const NumaTopology &get();
+
+    unsigned int nodeCount() const { return static_cast<unsigned int>(nodeCpus.size()); }
+
+    // node the calling thread runs on right now, 0 if unknown
+    unsigned int currentNode() const;
+
+    // every cpu, alternating between nodes, so the first n workers pinned in this order are spread evenly
+    std::vector<unsigned int> spreadCpus() const;
+};
+
+// Pins the calling thread to one cpu until the pin goes out of scope, which restores the old affinity.
+class ThreadPin
+{
+public:
+    explicit ThreadPin(unsigned int cpu);
+    ~ThreadPin();
+
+    ThreadPin(const ThreadPin &) = delete;
+    ThreadPin &operator=(const ThreadPin &) = delete;
+
+private:
+    bool pinned = false;
+    std::vector<uint8_t> previous; // cpu_set_t
+};
+
+// Page aligned, zero filled memory with a placement. Pages are only touched when written, so with
+// PLACE_LOCAL they land on the node of the thread that writes them first. Buffers of at least one
+// huge page can ask for transparent huge pages, fewer TLB misses on large BVHs.
+class PlacedBuffer
+{
+public:
+    static constexpr size_t HUGE_PAGE = size_t(2) << 20;
+
+    PlacedBuffer() = default;
+    PlacedBuffer(size_t bytes, Placement placement, unsigned int node = 0, bool hugePages = false);
+    ~PlacedBuffer();
+
+    PlacedBuffer(PlacedBuffer &&other) noexcept;
+    PlacedBuffer &operator=(PlacedBuffer &&other) noexcept;
+
+    void *data() { return ptr; }
+    const void *data() const { return ptr; }
+    size_t size() const { return bytes; }
+    bool hugePages() const { return huge; } // madvise accepted, the kernel still decides per page
+
+private:
+    void *ptr = nullptr;
+    size_t bytes = 0;
+    void *mapping = nullptr; // what to unmap, can start before ptr when aligned for huge pages
+    size_t mappingBytes = 0;
+    bool huge = false;
+
+    void release();
+};
+
+// Fixed size array of trivially copyable T in a PlacedBuffer.
+template <class T>
+class PlacedArray
+{
+public:
+    PlacedArray() = default;
+    PlacedArray(size_t count, Placement placement, unsigned int node = 0, bool hugePages = false)
+        : buffer(count * sizeof(T), placement, node, hugePages), count(count) {}
+
+    T *data() { return static_cast<T *>(buffer.data()); }
+    const T *data() const { return static_cast<const T *>(buffer.data()); }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool hugePages() const { return buffer.hugePages(); }
+
+    T &operator[](size_t i) { return data()[i]; }
+    const T &operator[](size_t i) const { return data()[i]; }
+
+private:
+    PlacedBuffer buffer;
+    size_t count = 0;
+};
+
+// copy of source placed as asked, written by the calling thread after the placement is set
+template <class T>
+PlacedArray<T> placedCopy(const std::vector<T> &source, Placement placement, unsigned int node, bool hugePages)
+{
+    PlacedArray<T> copy(source.size(), placement, node, hugePages);
+    for (size_t i = 0; i < source.size(); i++)
+        copy[i] = source[i];
+    return copy;
+}
+
+#endif
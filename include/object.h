@@ -69,6 +69,12 @@ struct GPUSphere
     glm::vec4 emission;
 };
 
+struct GPUSceneData
+{
+    uint32_t maxBounce;
+    uint32_t numRaysPerPixel;
+};
+
 struct Rectangle
 {
     Transform transform;
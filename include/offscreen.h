@@ -0,0 +1,34 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <memory>
+
+#ifdef HAS_EGL
+#include <EGL/egl.h>
+#endif
+
+#include "window.h"
+
+// A GL 4.3 core context for rendering into textures only, current on the thread that created it.
+// Surfaceless EGL when built with EGL, which also works on Mesa's software rasterizer on machines
+// without a GPU or display, and a hidden GLFW window otherwise. Used by --headless and --serve.
+class OffscreenContext
+{
+public:
+    ~OffscreenContext();
+
+    // width and height only size the fallback window
+    bool create(unsigned int width, unsigned int height);
+
+private:
+#ifdef HAS_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool createSurfaceless();
+    bool fail(const char *call);
+#endif
+    std::unique_ptr<Window> window;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <cstdint>
+#include <string>
+
+#include "bvh.h"
+
+// Coherent ray packets against the BVH::GPUNode tree for the CPU backend. A packet is traced 4, 8
+// or 16 rays at a time with SSE, AVX2 or AVX-512, whichever the CPU supports: one box test covers
+// every ray of the packet and Moller-Trumbore runs across the rays of a leaf triangle. Subtrees only
+// a few rays of the packet still reach are finished one ray at a time.
+
+enum PacketISA
+{
+    ISA_SCALAR, // one ray at a time, same traversal as CPUTracer::rayBVH
+    ISA_SSE,    // 4 rays
+    ISA_AVX2,   // 8 rays
+    ISA_AVX512, // 16 rays
+    ISA_COUNT
+};
+
+struct RayPacket
+{
+    static constexpr uint32_t MAX_RAYS = 16;
+    static constexpr uint32_t NO_HIT = UINT32_MAX;
+
+    // structure of arrays, lane i is ray i
+    float ox[MAX_RAYS], oy[MAX_RAYS], oz[MAX_RAYS];
+    float dx[MAX_RAYS], dy[MAX_RAYS], dz[MAX_RAYS];
+    float tMax[MAX_RAYS];        // in: only hits closer than this count (e.g. a sphere), out: closest hit
+    uint32_t triangle[MAX_RAYS]; // out: index of the closest triangle, NO_HIT if none is closer than tMax
+    uint32_t count = 0;
+};
+
+struct BVHView
+{
+    const BVH::GPUNode *nodes;
+    const GPUTriangle *triangles; // in BVH leaf order
+};
+
+const char *packetISAName(PacketISA isa);
+bool parsePacketISA(const std::string &name, PacketISA &isa);
+
+uint32_t packetWidth(PacketISA isa);
+
+// compiled in and supported by this CPU
+bool packetISASupported(PacketISA isa);
+PacketISA bestPacketISA();
+
+// Closest triangle hit of every ray in the packet, in groups of packetWidth(isa) rays.
+// Falls back to ISA_SCALAR when isa isn't supported here.
+void intersectPacket(PacketISA isa, const BVHView &bvh, RayPacket &packet);
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef PACKET_KERNEL_H
+#define PACKET_KERNEL_H
+
+// Traversal code behind intersectPacket and intersectWide, included once by each packet_*.cpp, every one of them
+// compiled for its own ISA. Everything here has internal linkage and calls no inline functions of
+// other headers (glm, <algorithm>): the linker keeps one copy of an inline function, and the copy
+// compiled with -mavx512f could end up serving the scalar path on a CPU without AVX-512.
+
+#include "packet.h"
+#include "simd.h"
+#include "widebvh.h"
+
+using PacketKernel = void (*)(const BVHView &bvh, RayPacket &packet, uint32_t first);
+
+template <uint32_t W>
+using WideKernel = void (*)(const typename WideBVH<W>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle);
+
+// nullptr when the translation unit was compiled without the ISA
+PacketKernel packetKernelSSE();
+PacketKernel packetKernelAVX2();
+PacketKernel packetKernelAVX512();
+WideKernel<4> wideKernelSSE();
+WideKernel<8> wideKernelAVX2();
+WideKernel<4> wideOcclusionKernelSSE();
+WideKernel<8> wideOcclusionKernelAVX2();
+
+namespace
+{
+    constexpr uint32_t STACK_SIZE = 64;
+
+    inline float minf(float a, float b) { return a < b ? a : b; }
+    inline float maxf(float a, float b) { return a > b ? a : b; }
+
+    inline uint32_t laneCount(uint32_t mask)
+    {
+        uint32_t count = 0;
+        for (; mask != 0; mask &= mask - 1)
+            count++;
+        return count;
+    }
+
+    inline uint32_t firstLane(uint32_t mask)
+    {
+        uint32_t lane = 0;
+        while (!(mask & (1u << lane)))
+            lane++;
+        return lane;
+    }
+
+    inline bool laneAABB(const float o[3], const float inv[3], const BVH::GPUNode &node, float tMax)
+    {
+        float tx0 = (node.min.x - o[0]) * inv[0], tx1 = (node.max.x - o[0]) * inv[0];
+        float ty0 = (node.min.y - o[1]) * inv[1], ty1 = (node.max.y - o[1]) * inv[1];
+        float tz0 = (node.min.z - o[2]) * inv[2], tz1 = (node.max.z - o[2]) * inv[2];
+
+        float tNear = maxf(maxf(minf(tx0, tx1), minf(ty0, ty1)), minf(tz0, tz1));
+        float tFar = minf(minf(maxf(tx0, tx1), maxf(ty0, ty1)), maxf(tz0, tz1));
+
+        return tFar >= maxf(tNear, 0.0f) && tNear < tMax;
+    }
+
+    // Single ray through the subtree at root, whose box the ray already hit. Same arithmetic as
+    // CPUTracer::rayBVH so both find the same triangle.
+    inline void intersectLane(const BVHView &bvh, uint32_t root, const float o[3], const float d[3], const float inv[3],
+                       float &tMax, uint32_t &triangle)
+    {
+        uint32_t stack[STACK_SIZE];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = root;
+
+        while (stackPtr > 0)
+        {
+            const BVH::GPUNode &node = bvh.nodes[stack[--stackPtr]];
+
+            if (node.triangleCount > 0)
+            {
+                for (uint32_t i = 0; i < node.triangleCount; i++)
+                {
+                    const GPUTriangle &tri = bvh.triangles[node.left + i];
+
+                    float e1[3] = {tri.b.x - tri.a.x, tri.b.y - tri.a.y, tri.b.z - tri.a.z};
+                    float e2[3] = {tri.c.x - tri.a.x, tri.c.y - tri.a.y, tri.c.z - tri.a.z};
+                    float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+
+                    float det = -(d[0] * n[0] + d[1] * n[1] + d[2] * n[2]);
+                    if (det < 1E-6f)
+                        continue; // back face
+
+                    float invdet = 1.0f / det;
+                    float ao[3] = {o[0] - tri.a.x, o[1] - tri.a.y, o[2] - tri.a.z};
+                    float dao[3] = {ao[1] * d[2] - ao[2] * d[1], ao[2] * d[0] - ao[0] * d[2], ao[0] * d[1] - ao[1] * d[0]};
+
+                    float u = (e2[0] * dao[0] + e2[1] * dao[1] + e2[2] * dao[2]) * invdet;
+                    if (u < 0.0f || u > 1.0f)
+                        continue;
+
+                    float v = -(e1[0] * dao[0] + e1[1] * dao[1] + e1[2] * dao[2]) * invdet;
+                    if (v < 0.0f || u + v > 1.0f)
+                        continue;
+
+                    float dist = (ao[0] * n[0] + ao[1] * n[1] + ao[2] * n[2]) * invdet;
+                    if (dist < 0.0f || dist >= tMax)
+                        continue;
+
+                    tMax = dist;
+                    triangle = node.left + i;
+                }
+            }
+            else
+            {
+                if (laneAABB(o, inv, bvh.nodes[node.left], tMax) && stackPtr < STACK_SIZE)
+                    stack[stackPtr++] = node.left;
+                if (laneAABB(o, inv, bvh.nodes[node.right], tMax) && stackPtr < STACK_SIZE)
+                    stack[stackPtr++] = node.right;
+            }
+        }
+    }
+
+    // Packet of V::SIZE rays starting at lane first. Nodes are box tested when popped, against
+    // each ray's closest hit so far, and once no more than V::SIZE / 4 rays still reach a node
+    // the packet has diverged and those rays finish its subtree on their own.
+    template <class V>
+    void intersectGroup(const BVHView &bvh, RayPacket &packet, uint32_t first)
+    {
+        constexpr uint32_t N = V::SIZE;
+        constexpr uint32_t DIVERGED = N / 4;
+
+        uint32_t count = packet.count - first < N ? packet.count - first : N;
+        uint32_t valid = (1u << count) - 1;
+
+        // rays past count repeat the first one so every lane stays finite, valid masks them out
+        alignas(64) float o[3][N], d[3][N], inv[3][N], tMax[N];
+        uint32_t triangle[N];
+        for (uint32_t lane = 0; lane < N; lane++)
+        {
+            uint32_t ray = first + (lane < count ? lane : 0);
+            o[0][lane] = packet.ox[ray];
+            o[1][lane] = packet.oy[ray];
+            o[2][lane] = packet.oz[ray];
+            d[0][lane] = packet.dx[ray];
+            d[1][lane] = packet.dy[ray];
+            d[2][lane] = packet.dz[ray];
+            for (int axis = 0; axis < 3; axis++)
+                inv[axis][lane] = 1.0f / d[axis][lane];
+            tMax[lane] = packet.tMax[ray];
+            triangle[lane] = RayPacket::NO_HIT;
+        }
+
+        const V ox = V::load(o[0]), oy = V::load(o[1]), oz = V::load(o[2]);
+        const V dx = V::load(d[0]), dy = V::load(d[1]), dz = V::load(d[2]);
+        const V ix = V::load(inv[0]), iy = V::load(inv[1]), iz = V::load(inv[2]);
+        const V zero(0.0f), one(1.0f), epsilon(1E-6f);
+        V t = V::load(tMax);
+
+        uint32_t stack[STACK_SIZE];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = 0;
+
+        while (stackPtr > 0)
+        {
+            uint32_t nodeIndex = stack[--stackPtr];
+            const BVH::GPUNode &node = bvh.nodes[nodeIndex];
+
+            // -- Packet vs Box --
+            V tx0 = (V(node.min.x) - ox) * ix, tx1 = (V(node.max.x) - ox) * ix;
+            V ty0 = (V(node.min.y) - oy) * iy, ty1 = (V(node.max.y) - oy) * iy;
+            V tz0 = (V(node.min.z) - oz) * iz, tz1 = (V(node.max.z) - oz) * iz;
+
+            V tNear = max(max(min(tx0, tx1), min(ty0, ty1)), min(tz0, tz1));
+            V tFar = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1));
+
+            uint32_t active = ((tFar >= max(tNear, zero)) & (tNear < t)).bits() & valid;
+            if (active == 0)
+                continue;
+
+            // -- Diverged --
+            if (laneCount(active) <= DIVERGED)
+            {
+                t.store(tMax);
+                for (uint32_t lane = 0; lane < N; lane++)
+                {
+                    if (!(active & (1u << lane)))
+                        continue;
+                    float lo[3] = {o[0][lane], o[1][lane], o[2][lane]};
+                    float ld[3] = {d[0][lane], d[1][lane], d[2][lane]};
+                    float li[3] = {inv[0][lane], inv[1][lane], inv[2][lane]};
+                    intersectLane(bvh, nodeIndex, lo, ld, li, tMax[lane], triangle[lane]);
+                }
+                t = V::load(tMax);
+                continue;
+            }
+
+            if (node.triangleCount == 0)
+            {
+                // the child nearer to the first active ray is popped first
+                const BVH::GPUNode &left = bvh.nodes[node.left];
+                const BVH::GPUNode &right = bvh.nodes[node.right];
+                uint32_t lane = firstLane(active);
+                float leftDist = (left.min.x + left.max.x - 2.0f * o[0][lane]) * d[0][lane] +
+                                 (left.min.y + left.max.y - 2.0f * o[1][lane]) * d[1][lane] +
+                                 (left.min.z + left.max.z - 2.0f * o[2][lane]) * d[2][lane];
+                float rightDist = (right.min.x + right.max.x - 2.0f * o[0][lane]) * d[0][lane] +
+                                  (right.min.y + right.max.y - 2.0f * o[1][lane]) * d[1][lane] +
+                                  (right.min.z + right.max.z - 2.0f * o[2][lane]) * d[2][lane];
+
+                if (stackPtr + 2 > STACK_SIZE)
+                    continue;
+                stack[stackPtr++] = leftDist < rightDist ? node.right : node.left;
+                stack[stackPtr++] = leftDist < rightDist ? node.left : node.right;
+                continue;
+            }
+
+            // -- Packet vs Triangles -- Moller-Trumbore with back faces culled, one triangle against all rays
+            for (uint32_t i = 0; i < node.triangleCount; i++)
+            {
+                const GPUTriangle &tri = bvh.triangles[node.left + i];
+
+                float e1[3] = {tri.b.x - tri.a.x, tri.b.y - tri.a.y, tri.b.z - tri.a.z};
+                float e2[3] = {tri.c.x - tri.a.x, tri.c.y - tri.a.y, tri.c.z - tri.a.z};
+                float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+
+                V det = zero - (dx * V(n[0]) + dy * V(n[1]) + dz * V(n[2]));
+                V invdet = one / det;
+
+                V aox = ox - V(tri.a.x), aoy = oy - V(tri.a.y), aoz = oz - V(tri.a.z);
+                V daox = aoy * dz - aoz * dy;
+                V daoy = aoz * dx - aox * dz;
+                V daoz = aox * dy - aoy * dx;
+
+                V u = (V(e2[0]) * daox + V(e2[1]) * daoy + V(e2[2]) * daoz) * invdet;
+                V v = (zero - (V(e1[0]) * daox + V(e1[1]) * daoy + V(e1[2]) * daoz)) * invdet;
+                V dist = (aox * V(n[0]) + aoy * V(n[1]) + aoz * V(n[2])) * invdet;
+
+                uint32_t hits = ((det >= epsilon) & (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one) &
+                                 (dist >= zero) & (dist < t))
+                                    .bits() &
+                                active;
+                if (hits == 0)
+                    continue;
+
+                // hits are rare next to the tests, so the update is done per lane
+                alignas(64) float hitDist[N];
+                dist.store(hitDist);
+                t.store(tMax);
+                for (uint32_t lane = 0; lane < N; lane++)
+                {
+                    if (hits & (1u << lane))
+                    {
+                        tMax[lane] = hitDist[lane];
+                        triangle[lane] = node.left + i;
+                    }
+                }
+                t = V::load(tMax);
+            }
+        }
+
+        t.store(tMax);
+        for (uint32_t lane = 0; lane < count; lane++)
+        {
+            if (triangle[lane] == RayPacket::NO_HIT)
+                continue;
+            packet.tMax[first + lane] = tMax[lane];
+            packet.triangle[first + lane] = triangle[lane];
+        }
+    }
+
+    // One ray through a WideBVH<V::SIZE>: a node's children are box tested together and the hit
+    // ones pushed far to near, a leaf's triangles are tested a block at a time. Entries keep the
+    // distance their box was entered at, so the ones behind the closest hit found since are skipped.
+    // With ANY_HIT the first triangle closer than tMax ends the traversal, enough for occlusion.
+    template <class V, bool ANY_HIT = false>
+    void intersectWideRay(const typename WideBVH<V::SIZE>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle)
+    {
+        constexpr uint32_t W = V::SIZE;
+        using Tree = WideBVH<W>;
+
+        struct Entry
+        {
+            uint32_t child;
+            float tNear;
+        };
+
+        const V ox(origin[0]), oy(origin[1]), oz(origin[2]);
+        const V dx(direction[0]), dy(direction[1]), dz(direction[2]);
+        const V ix(1.0f / direction[0]), iy(1.0f / direction[1]), iz(1.0f / direction[2]);
+        const V zero(0.0f), one(1.0f), epsilon(1E-6f);
+
+        triangle = RayPacket::NO_HIT;
+        if (!bvh.nodes)
+            return;
+
+        Entry stack[STACK_SIZE * W];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = {0, 0.0f};
+
+        while (stackPtr > 0)
+        {
+            Entry entry = stack[--stackPtr];
+            if (entry.tNear >= tMax)
+                continue;
+
+            if (entry.child & Tree::LEAF)
+            {
+                // -- Ray vs Triangle Blocks --
+                const typename Tree::Leaf &leaf = bvh.leaves[entry.child & ~Tree::LEAF];
+                for (uint32_t b = leaf.firstBlock; b < leaf.firstBlock + leaf.blockCount; b++)
+                {
+                    const typename Tree::TriangleBlock &block = bvh.blocks[b];
+                    const V nx = V::load(block.nx), ny = V::load(block.ny), nz = V::load(block.nz);
+
+                    V det = zero - (dx * nx + dy * ny + dz * nz);
+                    V invdet = one / det;
+
+                    V aox = ox - V::load(block.ax), aoy = oy - V::load(block.ay), aoz = oz - V::load(block.az);
+                    V daox = aoy * dz - aoz * dy;
+                    V daoy = aoz * dx - aox * dz;
+                    V daoz = aox * dy - aoy * dx;
+
+                    V u = (V::load(block.e2x) * daox + V::load(block.e2y) * daoy + V::load(block.e2z) * daoz) * invdet;
+                    V v = (zero - (V::load(block.e1x) * daox + V::load(block.e1y) * daoy + V::load(block.e1z) * daoz)) * invdet;
+                    V dist = (aox * nx + aoy * ny + aoz * nz) * invdet;
+
+                    // empty lanes have det = 0 and never hit
+                    uint32_t hits = ((det >= epsilon) & (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one) &
+                                     (dist >= zero) & (dist < V(tMax)))
+                                        .bits();
+                    if (hits == 0)
+                        continue;
+
+                    alignas(64) float hitDist[W];
+                    dist.store(hitDist);
+                    for (uint32_t lane = 0; lane < W; lane++)
+                    {
+                        if ((hits & (1u << lane)) && hitDist[lane] < tMax)
+                        {
+                            tMax = hitDist[lane];
+                            triangle = block.triangle[lane];
+                        }
+                    }
+                    if (ANY_HIT)
+                        return;
+                }
+                continue;
+            }
+
+            // -- Ray vs Children --
+            const typename Tree::Node &node = bvh.nodes[entry.child];
+            V tx0 = (V::load(node.minX) - ox) * ix, tx1 = (V::load(node.maxX) - ox) * ix;
+            V ty0 = (V::load(node.minY) - oy) * iy, ty1 = (V::load(node.maxY) - oy) * iy;
+            V tz0 = (V::load(node.minZ) - oz) * iz, tz1 = (V::load(node.maxZ) - oz) * iz;
+
+            V tNear = max(max(min(tx0, tx1), min(ty0, ty1)), min(tz0, tz1));
+            V tFar = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1));
+
+            uint32_t hits = ((tFar >= max(tNear, zero)) & (tNear < V(tMax))).bits() & ((1u << node.childCount) - 1);
+            if (hits == 0)
+                continue;
+
+            alignas(64) float nearDist[W];
+            tNear.store(nearDist);
+
+            // insertion sort of the hit children, nearest last so it's popped first
+            Entry sorted[W];
+            uint32_t count = 0;
+            for (uint32_t lane = 0; lane < W; lane++)
+            {
+                if (!(hits & (1u << lane)))
+                    continue;
+
+                Entry child{node.child[lane], nearDist[lane]};
+                uint32_t i = count++;
+                for (; i > 0 && sorted[i - 1].tNear < child.tNear; i--)
+                    sorted[i] = sorted[i - 1];
+                sorted[i] = child;
+            }
+
+            for (uint32_t i = 0; i < count && stackPtr < STACK_SIZE * W; i++)
+                stack[stackPtr++] = sorted[i];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PERMUTATIONS_H
+#define PERMUTATIONS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "object.h"
+
+// Scene properties raytracer.comp can be specialized on, see the defines at the top of the shader.
+struct RaytracerFeatures
+{
+    bool spheres = true;
+    bool triangles = true;
+    bool diffuseOnly = false;
+    uint32_t maxBounce = 0; // 0 = read sceneData.maxBounce at runtime
+
+    static RaytracerFeatures fromScene(const Scene &scene, size_t triangleCount, uint32_t maxBounce);
+
+    std::vector<std::string> defines() const;
+};
+
+// Compiles specialized variants of one compute shader on first use and keeps them around.
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(const char *computePath);
+    ~ShaderPermutations();
+
+    const Shader &get(const std::vector<std::string> &defines);
+
+private:
+    std::string path;
+    std::map<std::string, Shader> variants; // keyed by the sorted define list
+};
+
+#endif
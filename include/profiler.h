@@ -0,0 +1,76 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Times the passes of every frame with GL_TIME_ELAPSED queries. Each frame in flight gets its own
+// set of queries, so results are read a few frames late instead of stalling the pipeline.
+class GPUProfiler
+{
+public:
+    enum Pass
+    {
+        TRACE,   // raytracer dispatches, including the accumulation
+        DENOISE, // a-trous filter passes
+        DISPLAY, // fullscreen quad
+        UI,      // imgui draw data
+        PASS_COUNT
+    };
+    static constexpr const char *PASS_NAMES[PASS_COUNT] = {"trace", "denoise", "display", "ui"};
+
+    // GPU time of one displayed frame, per pass.
+    struct FrameTiming
+    {
+        uint64_t frame;
+        float cpuMs;               // wall clock frame time, includes vsync
+        float passMs[PASS_COUNT];  // 0 for passes that didn't run
+        bool ran[PASS_COUNT];      // passes timed this frame
+        uint32_t samples;          // samples per pixel traced this frame
+        uint64_t rays;             // camera paths traced this frame
+    };
+
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    static constexpr size_t HISTORY = 512; // finished frames kept for percentiles and export
+
+    GPUProfiler();
+    ~GPUProfiler();
+
+    // Passes can't overlap, GL only allows one active GL_TIME_ELAPSED query.
+    void begin(Pass pass);
+    void end(Pass pass);
+
+    void endFrame(float cpuMs, uint32_t samples, uint64_t rays);
+
+    // Frames that finished since the last call, oldest first.
+    std::vector<FrameTiming> takeFinished();
+
+    float percentile(Pass pass, float p) const; // p in [0, 1], ms, over the frames the pass ran in
+    double megaRaysPerSecond() const;           // over the whole history
+    bool exportCSV(const std::string &path) const;
+
+private:
+    struct FrameQueries
+    {
+        GLuint queries[PASS_COUNT];
+        bool used[PASS_COUNT];
+        bool pending;
+        FrameTiming timing;
+    };
+
+    FrameQueries frames[FRAMES_IN_FLIGHT];
+    int current = 0;
+    int open = PASS_COUNT; // pass between begin and end, PASS_COUNT if none
+    uint64_t frameCount = 0;
+
+    std::deque<FrameTiming> history;
+    std::vector<FrameTiming> finished;
+
+    bool ready(const FrameQueries &frame) const;
+    void collect(FrameQueries &frame);
+};
+
+#endif
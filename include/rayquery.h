@@ -0,0 +1,92 @@
+#ifndef RAYQUERY_H
+#define RAYQUERY_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "packet.h"
+#include "widebvh.h"
+
+// Ray queries against a triangle mesh on the CPU, for tools that only need the BVH and not the
+// renderer: visibility checks, AO baking, picking. Rays are handed over in streams and traced one
+// at a time through the wide BVH kernels of the CPU backend (see widebvh.h), occlusion rays stop at
+// the first hit. Streams can be cut into batches whose rays are sorted by where they start and the
+// way they point before tracing. Results come back in the order the rays went in.
+//
+// Queries are const and allocate their own scratch, so any number of threads can query one
+// RayQuery at the same time.
+
+struct QueryRay
+{
+    glm::vec3 origin;
+    float tMax; // only hits closer than this count, in units of the direction's length
+    glm::vec3 direction;
+    float pad;
+};
+
+struct QueryHit
+{
+    float distance;     // along direction, tMax when nothing was hit
+    uint32_t primitive; // index of the input triangle, RayQuery::MISS when nothing was hit
+    float u, v;         // barycentrics, hit point = (1 - u - v) * a + u * b + v * c
+};
+
+struct RayQueryOptions
+{
+    BVH::Builder builder = BVH::BINNED_SAH;
+    bool twoSided = true;            // false culls back faces like the renderer, faster but misses them
+    PacketISA isa = bestPacketISA(); // ISA_SCALAR for the plain binary BVH traversal
+
+    // Rays sorted together, 0 traces them in the order given. Sorting only pays for shuffled rays
+    // over scenes much larger than the caches, and needs batches of tens of thousands of rays to
+    // find neighbors there. Streams that are already coherent (pixels, texels) only get slower.
+    uint32_t reorderBatch = 0;
+};
+
+class RayQuery
+{
+public:
+    static constexpr uint32_t MISS = UINT32_MAX;
+
+    // indices has 3 per triangle, counterclockwise seen from the front
+    RayQuery(const std::vector<glm::vec3> &vertices, const std::vector<uint32_t> &indices, const RayQueryOptions &options = RayQueryOptions());
+    explicit RayQuery(const std::vector<GPUTriangle> &triangles, const RayQueryOptions &options = RayQueryOptions());
+
+    // closest triangle hit of each ray
+    void closestHit(const QueryRay *rays, QueryHit *hits, size_t count) const;
+    std::vector<QueryHit> closestHit(const std::vector<QueryRay> &rays) const;
+
+    // 1 if any triangle is closer than tMax, 0 if not. Stops at the first hit, cheaper than closestHit.
+    void occluded(const QueryRay *rays, uint8_t *results, size_t count) const;
+    std::vector<uint8_t> occluded(const std::vector<QueryRay> &rays) const;
+
+    const RayQueryOptions &queryOptions() const { return options; }
+    size_t primitiveCount() const { return primitives; }
+    double buildMs = 0.0; // BVH and wide BVH
+
+private:
+    RayQueryOptions options;
+    size_t primitives = 0;
+
+    // pad0 is the input triangle, pad1 is 1 for the reversed copies of twoSided
+    std::vector<GPUTriangle> triangles;
+    std::vector<BVH::GPUNode> nodes;
+    WideBVH<4> wide4;
+    WideBVH<8> wide8;
+    uint32_t wideWidth = 0;
+
+    glm::vec3 boundsMin = glm::vec3(0), boundsSize = glm::vec3(1); // for the sort keys
+
+    void build(std::vector<GPUTriangle> triangles);
+    void sortBatch(const QueryRay *rays, size_t count, uint32_t *order) const;
+    void traceRay(const QueryRay &ray, bool anyHit, float &tMax, uint32_t &triangle) const;
+    void finishHit(const QueryRay &ray, uint32_t triangle, float distance, QueryHit &hit) const;
+
+    // visit(index, tMax, triangle) for each ray, in batch order
+    template <class Visit>
+    void traceStream(const QueryRay *rays, size_t count, bool anyHit, const Visit &visit) const;
+};
+
+#endif
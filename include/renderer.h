@@ -0,0 +1,104 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "object.h"
+#include "bvh.h"
+#include "shader.h"
+#include "denoiser.h"
+#include "permutations.h"
+#include "autotune.h"
+#include "stats.h"
+#include "sampler.h"
+
+// GPU side of the path tracer: scene buffers, the accumulation and g-buffer images and the raytracer
+// variants. Shared by the interactive engine and the benchmarks, needs a current GL 4.3 context.
+class Renderer
+{
+public:
+    // -- Settings --
+    bool reprojection = true;   // reproject the accumulation on camera motion instead of resetting it
+    float historyLimit = 32.0f; // frames a reprojected pixel may keep, lower = less ghosting
+    SamplerType samplerType = SamplerType::SOBOL;
+    GPUSceneData sceneData{5, 1}; // maxBounce, numRaysPerPixel
+    BVH::Builder bvhBuilder = BVH::BINNED_SAH;
+    uint32_t seed = 0; // sampler seed, renders with different seeds are statistically independent
+    uint32_t traceFirstRow = 0; // rows [traceFirstRow, traceLastRow) are traced, the rest of the
+    uint32_t traceLastRow = 0;  // accumulation is left as it is, 0 = height (see HybridTracer)
+
+    // -- Load Timings -- (of the last loadScene)
+    double convertMs = 0.0; // convertToGPUMeshes
+    double bvhMs = 0.0;
+    double uploadMs = 0.0;
+    size_t triangleCount = 0;
+    size_t nodeCount = 0;
+
+    uint32_t frameIndex = 0;  // raytracer dispatches since the accumulation was reset
+    uint32_t sampleIndex = 0; // samples per pixel accumulated since then
+
+    const unsigned int width, height;
+    unsigned int accumTex; // rgb = mean, a = sample count
+
+    // first hit g-buffer, used by the reprojection, the denoiser and as primary hit cache
+    unsigned int depthTex, normalTex, albedoTex;
+
+    Denoiser denoiser;
+    TraversalStats traversalStats;
+
+    Renderer(unsigned int width, unsigned int height);
+    ~Renderer();
+
+    // Builds the BVH, uploads the scene and picks the raytracer variant for it.
+    // Returns false if the C++ structs don't match the shader layouts.
+    bool loadScene(const Scene &scene);
+
+    // Times every work group shape on the loaded scene and keeps the fastest, see Autotuner.
+    bool autotune();
+
+    void setSamplesPerPixel(uint32_t samples);
+
+    // The next dispatch starts over, taking sample firstSample of every pixel first. Samples only
+    // depend on the pixel and their index, so renders of disjoint ranges add up to one render.
+    void resetAccumulation(uint32_t firstSample = 0);
+
+    // The next dispatch traces its primary rays instead of reusing the g-buffer's first hits, for
+    // rows whose g-buffer this accumulation didn't write (see HybridTracer::rebalance).
+    void invalidatePrimaryCache();
+
+    // Adds `dispatches` x numRaysPerPixel samples seen from camera. A moved camera reprojects
+    // the accumulation if reprojection is on and restarts it otherwise.
+    bool trace(const Camera &camera, bool cameraMoved, uint32_t dispatches = 1);
+
+    // Returns the texture to display, the denoised accumulation if the denoiser is on.
+    unsigned int denoise();
+
+private:
+    ShaderPermutations permutations;
+    RaytracerFeatures features;
+    WorkGroupSize workGroup;
+    const Shader *raytracer = nullptr;
+    const Shader *statsRaytracer = nullptr; // TRAVERSAL_STATS variant, compiled on first use
+    uint32_t statsFrame = 0;
+
+    // previous frame copies, read by the reprojection while the current frame is written
+    unsigned int historyTex, historyDepthTex;
+
+    unsigned int sphereSSBO = 0, matSSBO = 0, triSSBO = 0, bvhSSBO = 0, dataSSBO = 0, sobolSSBO = 0;
+    unsigned int cameraUBO = 0;
+    uint32_t sphereCount = 0;
+
+    Camera prevCamera; // camera the current accumulation was rendered with
+    bool primaryCacheStale = false; // set by invalidatePrimaryCache until the next dispatch
+
+    std::vector<std::string> variantDefines() const;
+    bool selectVariant();
+    void bindResources() const;
+    void setUniforms(const Shader &shader) const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+// CPU mirror of the sampler in raytracer.comp. Both must produce the same sequences.
+
+enum class SamplerType : uint32_t
+{
+    PCG = 0,   // independent white noise per draw
+    SOBOL = 1, // Owen-scrambled Sobol, padded in groups of SOBOL_DIMENSIONS
+};
+
+static constexpr uint32_t SOBOL_DIMENSIONS = 4; // dimensions in the uploaded direction table
+static constexpr uint32_t SOBOL_BITS = 32;      // direction numbers per dimension
+
+// sample dimensions used by one bounce of trace()
+static constexpr uint32_t DIM_HEMISPHERE = 0; // and DIM_HEMISPHERE + 1
+static constexpr uint32_t DIM_ROULETTE = 2;
+static constexpr uint32_t DIMS_PER_BOUNCE = 4;
+
+// Direction numbers for the first `dimensions` Sobol dimensions (Joe & Kuo), laid out [dim][bit].
+std::vector<uint32_t> buildSobolMatrices(uint32_t dimensions = SOBOL_DIMENSIONS);
+
+// hash() in raytracer.comp
+inline uint32_t integerHash(uint32_t x)
+{
+    x = ((x >> 16) ^ x) * 0x45d9f3bu;
+    x = ((x >> 16) ^ x) * 0x45d9f3bu;
+    x = (x >> 16) ^ x;
+    return x;
+}
+
+// PCG rng
+inline float randomFloat(uint32_t &rng)
+{
+    rng = rng * 747796405u + 2891336453u;
+    uint32_t result = ((rng >> ((rng >> 28u) + 4u)) ^ rng) * 277803737u;
+    result = (result >> 22u) ^ result;
+
+    return float(result) / 4294967295.0f;
+}
+
+inline uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Burley 2020, "Practical Hash-based Owen Scrambling"
+inline uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+struct Sampler
+{
+    SamplerType type;
+    const uint32_t *sobolMatrices; // buildSobolMatrices() table
+    uint32_t rng;                  // pcg state
+    uint32_t index;                // sample index of this pixel
+    uint32_t seed;                 // per pixel scramble seed
+
+    float sample(uint32_t dimension)
+    {
+        if (type == SamplerType::PCG)
+            return randomFloat(rng);
+
+        uint32_t groupSeed = integerHash(seed ^ integerHash(dimension / SOBOL_DIMENSIONS));
+        uint32_t shuffled = nestedUniformScramble(index, groupSeed);
+
+        const uint32_t *matrix = sobolMatrices + (dimension % SOBOL_DIMENSIONS) * SOBOL_BITS;
+        uint32_t x = 0;
+        for (uint32_t bit = 0; shuffled != 0; bit++, shuffled >>= 1)
+            if (shuffled & 1u)
+                x ^= matrix[bit];
+
+        x = nestedUniformScramble(x, integerHash(groupSeed + dimension));
+        return float(x >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+#endif
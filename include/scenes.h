@@ -0,0 +1,28 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "object.h"
+
+// A canned scene, used by the engine and the benchmarks so runs are comparable.
+struct SceneDesc
+{
+    const char *name;
+    void (*build)(Scene &scene);
+
+    // scripted camera paths orbit around target, see orbitCamera
+    glm::vec3 target;
+    float orbitRadius;
+    float orbitHeight;
+};
+
+const std::vector<SceneDesc> &sceneRegistry();
+const SceneDesc *findScene(const std::string &name); // nullptr if there is none
+
+// Camera on the orbit of desc at t in [0, 1), t = 0 looks along +x like the engine's start camera.
+Camera orbitCamera(const SceneDesc &desc, float t);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Long running render server, `engine --serve /tmp/engine.sock [--backend gpu|cpu]`. Listens on a
+// local UNIX socket and keeps what it loaded resident across jobs: built scenes by name, and up to
+// --resident n renderers with their BVH, buffers and raytracer variant by scene and resolution. So a
+// pipeline pays OBJ loading, BVH builds and shader compiles once instead of once per image.
+//
+// A request is one line of text, answered with one line, followed by the pixels for images:
+//
+//   render scene=dragon8k width=640 height=480 spp=64 orbit=0.25 priority=1 deadline=5000
+//   -> ok id=3 width=640 height=480 wait_ms=0.2 render_ms=812.4 bytes=4915200
+//      and bytes of float RGBA, rows bottom to top like image.h
+//   -> error id=3 <reason>
+//
+// Render keys are those of --headless: scene, width, height, spp, orbit or camera=x,y,z,yaw,pitch,
+// sampler=pcg|sobol and denoise=1 (GPU only), plus priority (higher first, default 0) and deadline
+// (ms after the request, a job not started by then fails). Width and height are at most --max-size
+// (default 4096). Queued jobs are taken by priority, then earliest deadline, then in order (see
+// jobqueue.h), one at a time. `status` answers with the queue length and counters, `shutdown` stops
+// the server after the job in progress.
+//
+// A connection is answered in order, clients open several to have more than one job queued.
+int runServer(int argc, char **argv);
+
+// Client for the above, `engine --submit /tmp/engine.sock --scene dragon8k --spp 64 --out dragon.pfm`.
+// Every other --key value goes into the request as key=value, the image is written to each --out.
+// `--status` and `--shutdown` send those instead.
+int runSubmit(int argc, char **argv);
+
+#endif
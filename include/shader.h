@@ -6,6 +6,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <initializer_list>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -16,20 +19,56 @@ enum ShaderType
     SOURCE
 };
 
+// One member of a C++ struct mirrored in a shader block, see Shader::checkLayout.
+struct LayoutField
+{
+    const char *name;
+    size_t offset;
+};
+
 class Shader
 {
 public:
     unsigned int ID;
 
     Shader(const char *vertexPath, const char *fragmentPath, ShaderType type);
-    Shader(const char *computePath);
+    Shader(const char *computePath, const std::vector<std::string> &defines = {}); // defines as "NAME" or "NAME VALUE"
 
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
+    void setUint(const std::string &name, unsigned int value) const;
     void setFloat(const std::string &name, float value) const;
     void setMat4(const std::string &name, glm::mat4 value) const;
     void setVec3(const std::string &name, glm::vec3 value) const;
     void setVec2(const std::string &name, glm::vec2 value) const;
+
+    // Dispatches enough work groups to cover a width x height grid, whatever the local size.
+    void dispatch(unsigned int width, unsigned int height) const;
+
+    // -- Reflection --
+    GLint uniformLocation(const std::string &name) const; // -1 if inactive
+    GLint blockBinding(GLenum programInterface, const std::string &block) const; // GL_UNIFORM_BLOCK / GL_SHADER_STORAGE_BLOCK, -1 if inactive
+
+    // Verifies that the linked layout matches a C++ struct. `prefix` is prepended to every field name
+    // (e.g. "spheres[0]." for an array of structs) and `stride` is the sizeof of the struct, 0 to skip it.
+    // Inactive fields are skipped, mismatches are printed and make it return false.
+    bool checkLayout(GLenum programInterface, const std::string &prefix, size_t stride, std::initializer_list<LayoutField> fields) const;
+    bool checkBlockBinding(GLenum programInterface, const std::string &block, GLint binding) const;
+
+private:
+    bool compute = false;
+    GLint workGroupSize[3] = {1, 1, 1}; // local_size_x/y/z of a compute program
+
+    std::unordered_map<std::string, GLint> uniforms;
+    std::unordered_map<std::string, GLint> blocks; // binding per block name
+
+    void reflect(); // caches uniform locations and block bindings once linked
+
+    static constexpr const char *BINARY_CACHE_DIR = "shader_cache"; // compiled compute programs, keyed by source + driver
+
+    static std::string binaryCachePath(const std::string &source);
+    bool loadBinary(const std::string &path);
+    void saveBinary(const std::string &path) const;
 };
 
 #endif
\ No newline at end of file
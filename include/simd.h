@@ -0,0 +1,123 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Thin wrappers over SSE, AVX2 and AVX-512 float vectors for the CPU ray kernels (see packet.h).
+// Every wrapper only exists in translation units compiled for its instruction set, the kernels are
+// templates over them so the same code is instantiated once per ISA.
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define SIMD_SSE 1
+#endif
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#endif
+#if defined(__AVX512F__)
+#define SIMD_AVX512 1
+#endif
+
+namespace simd
+{
+#ifdef SIMD_SSE
+    struct vfloat4
+    {
+        static constexpr int SIZE = 4;
+        struct Mask
+        {
+            __m128 m;
+            uint32_t bits() const { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+            Mask operator&(Mask o) const { return {_mm_and_ps(m, o.m)}; }
+        };
+
+        __m128 v;
+
+        vfloat4() = default;
+        vfloat4(__m128 v) : v(v) {}
+        explicit vfloat4(float f) : v(_mm_set1_ps(f)) {}
+        static vfloat4 load(const float *p) { return _mm_loadu_ps(p); }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+
+        friend vfloat4 operator+(vfloat4 a, vfloat4 b) { return _mm_add_ps(a.v, b.v); }
+        friend vfloat4 operator-(vfloat4 a, vfloat4 b) { return _mm_sub_ps(a.v, b.v); }
+        friend vfloat4 operator*(vfloat4 a, vfloat4 b) { return _mm_mul_ps(a.v, b.v); }
+        friend vfloat4 operator/(vfloat4 a, vfloat4 b) { return _mm_div_ps(a.v, b.v); }
+        friend vfloat4 min(vfloat4 a, vfloat4 b) { return _mm_min_ps(a.v, b.v); }
+        friend vfloat4 max(vfloat4 a, vfloat4 b) { return _mm_max_ps(a.v, b.v); }
+
+        friend Mask operator<(vfloat4 a, vfloat4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+        friend Mask operator<=(vfloat4 a, vfloat4 b) { return {_mm_cmple_ps(a.v, b.v)}; }
+        friend Mask operator>=(vfloat4 a, vfloat4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+        friend vfloat4 select(Mask m, vfloat4 a, vfloat4 b) { return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)); }
+    };
+#endif
+
+#ifdef SIMD_AVX2
+    struct vfloat8
+    {
+        static constexpr int SIZE = 8;
+        struct Mask
+        {
+            __m256 m;
+            uint32_t bits() const { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+            Mask operator&(Mask o) const { return {_mm256_and_ps(m, o.m)}; }
+        };
+
+        __m256 v;
+
+        vfloat8() = default;
+        vfloat8(__m256 v) : v(v) {}
+        explicit vfloat8(float f) : v(_mm256_set1_ps(f)) {}
+        static vfloat8 load(const float *p) { return _mm256_loadu_ps(p); }
+        void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+        friend vfloat8 operator+(vfloat8 a, vfloat8 b) { return _mm256_add_ps(a.v, b.v); }
+        friend vfloat8 operator-(vfloat8 a, vfloat8 b) { return _mm256_sub_ps(a.v, b.v); }
+        friend vfloat8 operator*(vfloat8 a, vfloat8 b) { return _mm256_mul_ps(a.v, b.v); }
+        friend vfloat8 operator/(vfloat8 a, vfloat8 b) { return _mm256_div_ps(a.v, b.v); }
+        friend vfloat8 min(vfloat8 a, vfloat8 b) { return _mm256_min_ps(a.v, b.v); }
+        friend vfloat8 max(vfloat8 a, vfloat8 b) { return _mm256_max_ps(a.v, b.v); }
+
+        friend Mask operator<(vfloat8 a, vfloat8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+        friend Mask operator<=(vfloat8 a, vfloat8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+        friend Mask operator>=(vfloat8 a, vfloat8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+        friend vfloat8 select(Mask m, vfloat8 a, vfloat8 b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+    };
+#endif
+
+#ifdef SIMD_AVX512
+    struct vfloat16
+    {
+        static constexpr int SIZE = 16;
+        struct Mask
+        {
+            __mmask16 m;
+            uint32_t bits() const { return static_cast<uint32_t>(m); }
+            Mask operator&(Mask o) const { return {static_cast<__mmask16>(m & o.m)}; }
+        };
+
+        __m512 v;
+
+        vfloat16() = default;
+        vfloat16(__m512 v) : v(v) {}
+        explicit vfloat16(float f) : v(_mm512_set1_ps(f)) {}
+        static vfloat16 load(const float *p) { return _mm512_loadu_ps(p); }
+        void store(float *p) const { _mm512_storeu_ps(p, v); }
+
+        friend vfloat16 operator+(vfloat16 a, vfloat16 b) { return _mm512_add_ps(a.v, b.v); }
+        friend vfloat16 operator-(vfloat16 a, vfloat16 b) { return _mm512_sub_ps(a.v, b.v); }
+        friend vfloat16 operator*(vfloat16 a, vfloat16 b) { return _mm512_mul_ps(a.v, b.v); }
+        friend vfloat16 operator/(vfloat16 a, vfloat16 b) { return _mm512_div_ps(a.v, b.v); }
+        friend vfloat16 min(vfloat16 a, vfloat16 b) { return _mm512_min_ps(a.v, b.v); }
+        friend vfloat16 max(vfloat16 a, vfloat16 b) { return _mm512_max_ps(a.v, b.v); }
+
+        friend Mask operator<(vfloat16 a, vfloat16 b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)}; }
+        friend Mask operator<=(vfloat16 a, vfloat16 b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ)}; }
+        friend Mask operator>=(vfloat16 a, vfloat16 b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ)}; }
+        friend vfloat16 select(Mask m, vfloat16 a, vfloat16 b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+    };
+#endif
+}
+
+#endif
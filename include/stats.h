@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <glad/glad.h>
+#include <cstdint>
+
+// PixelStats of raytracer.comp, written by the TRAVERSAL_STATS permutation.
+struct GPUPixelStats
+{
+    uint32_t nodes;
+    uint32_t aabbTests;
+    uint32_t triangleTests;
+    uint32_t rays;
+    uint32_t bounces;
+    uint32_t paths;
+    uint32_t maxNodes;
+    uint32_t pad;
+};
+
+// Per pixel traversal counters, shown as heatmaps by pass.frag and summed up for the stats panel.
+class TraversalStats
+{
+public:
+    enum View
+    {
+        COLOR,
+        NODES,          // per ray
+        AABB_TESTS,     // per ray
+        TRIANGLE_TESTS, // per ray
+        BOUNCES,        // per path
+        VIEW_COUNT
+    };
+    static constexpr const char *VIEW_NAMES[VIEW_COUNT] = {"Color", "Nodes", "AABB tests", "Triangle tests", "Bounces"};
+
+    static constexpr int REDUCE_INTERVAL = 30; // frames between readbacks, the buffer is large
+
+    bool enabled = false;
+    int view = COLOR;
+
+    // -- Totals -- (from the last readback)
+    double nodesPerRay = 0.0;
+    double aabbTestsPerRay = 0.0;
+    double triangleTestsPerRay = 0.0;
+    double bouncesPerPath = 0.0;
+    uint32_t maxNodes = 0;          // most nodes visited by a single ray
+    float viewMax[VIEW_COUNT] = {}; // highest per pixel value of each view, tops the heatmap color ramp
+
+    TraversalStats(unsigned int width, unsigned int height);
+    ~TraversalStats();
+
+    void bind(); // allocates the buffer on first use
+    void reduce();
+
+private:
+    unsigned int width, height;
+    unsigned int ssbo = 0;
+};
+
+#endif
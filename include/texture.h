@@ -0,0 +1,14 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// Allocates a float texture with nearest filtering, usable both as an image unit and a sampler.
+unsigned int createImageTexture(unsigned int width, unsigned int height, GLenum internalFormat, GLenum format);
+
+// Reads an image texture back as RGBA floats, rows bottom to top.
+std::vector<float> readImageTexture(unsigned int texture, unsigned int width, unsigned int height);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing over a grid of image tiles. The tiles are put in Hilbert curve order, so neighbors
+// on the curve are neighbors on screen, and each worker's deque is seeded with one contiguous
+// stretch of it. Workers take tiles from the front of their own deque, and once it runs dry steal
+// from the back of the others', where the tiles are furthest from what the owner is working on.
+// The worker threads are kept between runs, parked on a condition variable.
+class TileScheduler
+{
+public:
+    TileScheduler() = default;
+    ~TileScheduler();
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    struct WorkerStats
+    {
+        uint64_t tiles = 0;
+        uint64_t steals = 0; // tiles taken from another worker's deque
+        double busyMs = 0.0; // inside the work function
+    };
+
+    // Calls work(tile, worker) once for each tile of a tilesX x tilesY grid, tile = y * tilesX + x,
+    // on threadCount workers. The calling thread is worker 0. Returns once every tile is done. The
+    // pool is restarted when threadCount changes, runs mustn't overlap.
+    void run(uint32_t tilesX, uint32_t tilesY, unsigned int threadCount, const std::function<void(uint32_t tile, unsigned int worker)> &work);
+
+    // worker w runs pinned to workerCpus[w % size] for the length of a run, empty leaves them unpinned
+    std::vector<unsigned int> workerCpus;
+
+    // -- Stats -- summed over every run since the last reset
+    const std::vector<WorkerStats> &workerStats() const { return stats; }
+    double wallMs() const { return runMs; }
+    double utilization(unsigned int worker) const; // busy share of the wall time, 0..1
+    void resetStats();
+    void printStats() const;
+
+    // tile indices of a tilesX x tilesY grid along the Hilbert curve over it
+    static std::vector<uint32_t> hilbertOrder(uint32_t tilesX, uint32_t tilesY);
+
+private:
+    // one cache line each so workers don't contend on each other's locks
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> tiles;
+    };
+
+    std::unique_ptr<WorkerQueue[]> queues;
+    unsigned int queueCount = 0;
+
+    std::vector<uint32_t> order; // cached for the last grid
+    uint32_t orderX = 0, orderY = 0;
+
+    std::vector<WorkerStats> stats;
+    double runMs = 0.0;
+
+    // -- Pool -- workers 1.. wait for generation to change, then work on the current run
+    std::vector<std::thread> threads;
+    std::mutex poolMutex;
+    std::condition_variable wake, finished;
+    uint64_t generation = 0;
+    unsigned int running = 0; // pool workers not done with the current run
+    bool stopping = false;
+    const std::function<void(uint32_t tile, unsigned int worker)> *currentWork = nullptr;
+
+    void startPool(unsigned int count);
+    void stopPool();
+    void poolLoop(unsigned int worker, uint64_t seen);
+    void runWorker(unsigned int worker);
+
+    bool pop(unsigned int worker, uint32_t &tile);
+    bool steal(unsigned int worker, uint32_t &tile);
+};
+
+#endif
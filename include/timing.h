@@ -0,0 +1,12 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <chrono>
+
+// Wall milliseconds since start, on the steady clock.
+inline double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
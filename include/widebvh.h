@@ -0,0 +1,85 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "packet.h"
+
+// BVH with W = 4 or 8 children per node, collapsed from the binary one, for single incoherent rays
+// on the CPU. Nodes and leaf triangles are stored as structures of arrays so one SIMD slab test
+// covers every child of a node and one Moller-Trumbore test a whole block of W triangles. Diffuse
+// bounces scatter too much for packets, this is the CPU backend's path for them.
+template <uint32_t W>
+struct WideBVH
+{
+    static constexpr uint32_t LEAF = 0x80000000u; // child is LEAF | index into leaves
+
+    struct alignas(32) Node
+    {
+        float minX[W], minY[W], minZ[W];
+        float maxX[W], maxY[W], maxZ[W];
+        uint32_t child[W];
+        uint32_t childCount; // slots past it are empty
+    };
+
+    // triangles as a, the edges b - a, c - a and their cross product, unused lanes are all zero
+    struct alignas(32) TriangleBlock
+    {
+        float ax[W], ay[W], az[W];
+        float e1x[W], e1y[W], e1z[W];
+        float e2x[W], e2y[W], e2z[W];
+        float nx[W], ny[W], nz[W];
+        uint32_t triangle[W]; // index into the binary BVH's triangles
+    };
+
+    struct Leaf
+    {
+        uint32_t firstBlock;
+        uint32_t blockCount;
+    };
+
+    // what the kernels traverse, plain pointers keep std::vector code out of the per-ISA files
+    struct View
+    {
+        const Node *nodes; // nullptr when empty
+        const TriangleBlock *blocks;
+        const Leaf *leaves;
+    };
+
+    std::vector<Node> nodes; // root first
+    std::vector<TriangleBlock> blocks;
+    std::vector<Leaf> leaves;
+
+    WideBVH() = default;
+
+    // Children with the largest surface area are replaced by their own children until each
+    // node has W of them, each binary leaf becomes one leaf of blocks.
+    WideBVH(const std::vector<BVH::GPUNode> &binary, const std::vector<GPUTriangle> &triangles);
+
+    View view() const { return {nodes.empty() ? nullptr : nodes.data(), blocks.data(), leaves.data()}; }
+
+private:
+    uint32_t collapse(const std::vector<BVH::GPUNode> &binary, const std::vector<GPUTriangle> &triangles, uint32_t index);
+    uint32_t addLeaf(const BVH::GPUNode &node, const std::vector<GPUTriangle> &triangles);
+};
+
+extern template struct WideBVH<4>;
+extern template struct WideBVH<8>;
+
+// Node width the kernel for isa works on, 0 if there is none (scalar): SSE uses 4, AVX2 and
+// AVX-512 use 8. Falls back like intersectPacket when isa isn't supported here.
+uint32_t wideBVHWidth(PacketISA isa);
+
+// Closest triangle hit of one ray. tMax in: only hits closer than this count, out: the closest hit.
+// triangle is RayPacket::NO_HIT if none is closer. Only call with a width wideBVHWidth returned.
+// Takes a view so copies of the arrays placed elsewhere (see numa.h) can be traced too.
+void intersectWide(const WideBVH<4>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle);
+void intersectWide(const WideBVH<8>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle);
+
+// Like intersectWide but stops at the first triangle closer than tMax, which need not be the closest.
+void intersectWideAny(const WideBVH<4>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle);
+void intersectWideAny(const WideBVH<8>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle);
+
+#endif
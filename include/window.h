@@ -10,8 +10,8 @@ class Window
 {
 public:
     const unsigned int SCR_WIDTH, SCR_HEIGHT;
-    GLFWwindow *window;
-    Window(unsigned int width, unsigned int height, const char *title);
+    GLFWwindow *window = nullptr;
+    Window(unsigned int width, unsigned int height, const char *title, bool visible = true); // hidden windows are for benchmarks
     ~Window();
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "autotune.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+    // a mix of square tiles and wide rows, filtered by the device limits at run time
+    const WorkGroupSize CANDIDATES[] = {
+        {8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {64, 1}, {64, 2}, {64, 4}, {128, 1}, {256, 1}};
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte *value = glGetString(name);
+        return value ? reinterpret_cast<const char *>(value) : "unknown";
+    }
+}
+
+std::vector<std::string> WorkGroupSize::defines() const
+{
+    return {"LOCAL_SIZE_X " + std::to_string(x), "LOCAL_SIZE_Y " + std::to_string(y)};
+}
+
+Autotuner::Autotuner(const RaytracerFeatures &features, size_t triangleCount) : features(features)
+{
+    device = glString(GL_VENDOR) + " " + glString(GL_RENDERER);
+
+    // traversal cost grows with the log of the triangle count, so one bucket per order of magnitude
+    int magnitude = triangleCount > 0 ? static_cast<int>(std::log10(static_cast<double>(triangleCount))) : -1;
+    sceneClass = "tris 1e" + std::to_string(magnitude);
+    for (const std::string &define : features.defines())
+        sceneClass += " " + define;
+}
+
+bool Autotuner::load(WorkGroupSize &out) const
+{
+    std::ifstream file(CACHE_PATH);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string entryDevice, entryClass;
+        WorkGroupSize size;
+        if (!std::getline(fields, entryDevice, '\t') || !std::getline(fields, entryClass, '\t'))
+            continue;
+        if (entryDevice != device || entryClass != sceneClass)
+            continue;
+        if (!(fields >> size.x >> size.y) || size.x == 0 || size.y == 0)
+            continue;
+
+        out = size;
+        return true;
+    }
+    return false;
+}
+
+void Autotuner::save(const WorkGroupSize &size, double ms) const
+{
+    // keep every other entry, replace ours
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(CACHE_PATH);
+        std::string line;
+        while (std::getline(file, line))
+            if (line.rfind(device + "\t" + sceneClass + "\t", 0) != 0)
+                lines.push_back(line);
+    }
+
+    std::ostringstream entry;
+    entry << device << "\t" << sceneClass << "\t" << size.x << "\t" << size.y << "\t" << ms;
+    lines.push_back(entry.str());
+
+    std::ofstream file(CACHE_PATH, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "WARN: Could not write " << CACHE_PATH << std::endl;
+        return;
+    }
+    for (const std::string &line : lines)
+        file << line << "\n";
+}
+
+WorkGroupSize Autotuner::run(ShaderPermutations &permutations, unsigned int width, unsigned int height,
+                             const std::function<void(const Shader &)> &setUniforms, double &bestMs)
+{
+    GLint maxInvocations = 0;
+    GLint maxSize[2] = {0, 0};
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxSize[0]);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &maxSize[1]);
+
+    std::cerr << "autotune: " << device << " [" << sceneClass << "] at " << width << "x" << height << "\n";
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    WorkGroupSize best;
+    bestMs = -1.0;
+    for (const WorkGroupSize &candidate : CANDIDATES)
+    {
+        if (static_cast<GLint>(candidate.x * candidate.y) > maxInvocations ||
+            static_cast<GLint>(candidate.x) > maxSize[0] || static_cast<GLint>(candidate.y) > maxSize[1])
+            continue;
+
+        std::vector<std::string> defines = features.defines();
+        for (const std::string &define : candidate.defines())
+            defines.push_back(define);
+        const Shader &shader = permutations.get(defines);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+        if (!linked)
+            continue;
+
+        glUseProgram(shader.ID);
+        setUniforms(shader);
+
+        for (int i = 0; i < WARMUP_DISPATCHES; i++)
+            shader.dispatch(width, height);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        glFinish();
+
+        std::vector<double> times;
+        for (int i = 0; i < timedDispatches; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            shader.dispatch(width, height);
+            glEndQuery(GL_TIME_ELAPSED);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns); // waits for the dispatch
+            if (ns <= 1) // software drivers (llvmpipe) report 0 or 1 ns, fall back to the cpu clock
+            {
+                glFinish();
+                ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+            times.push_back(ns / 1e6);
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        double ms = times[times.size() / 2];
+
+        std::cerr << "autotune: " << std::setw(3) << candidate.x << "x" << std::left << std::setw(3) << candidate.y
+                  << std::right << " " << std::fixed << std::setprecision(3) << ms << " ms\n"
+                  << std::defaultfloat;
+
+        if (bestMs < 0.0 || ms < bestMs)
+        {
+            best = candidate;
+            bestMs = ms;
+        }
+    }
+
+    glDeleteQueries(1, &query);
+
+    std::cerr << "autotune: picked " << best.x << "x" << best.y << "\n";
+    return best;
+}
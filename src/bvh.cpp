@@ -1,6 +1,23 @@
 #include "bvh.h"
 
-BVH::BVH(std::vector<GPUTriangle> &triangles) : triangles(triangles)
+#include <algorithm>
+
+namespace
+{
+    glm::vec3 centroid(const GPUTriangle &tri)
+    {
+        return (glm::vec3(tri.a) + glm::vec3(tri.b) + glm::vec3(tri.c)) / 3.0f;
+    }
+
+    float surfaceArea(glm::vec3 min, glm::vec3 max)
+    {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f)); // empty bounds are inverted
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+}
+
+BVH::BVH(std::vector<GPUTriangle> &triangles, Builder builder, uint32_t leafTriangles)
+    : triangles(triangles), builder(builder), leafTriangles(leafTriangles)
 {
     GPUNode node{};
     node.left = 0;
@@ -17,25 +34,33 @@ BVH::BVH(std::vector<GPUTriangle> &triangles) : triangles(triangles)
     nodes.push_back(node);
 
     split(0);
-
-    std::cout << "bvh built with: " << nodes.size() << " nodes\n";
 }
 
 void BVH::split(const uint32_t nodeIndex, const int depth)
 {
     GPUNode &node = nodes[nodeIndex];
 
-    if (depth >= MAX_DEPTH || node.triangleCount <= LEAF_TRIANGLES)
+    if (depth >= MAX_DEPTH || node.triangleCount <= leafTriangles)
         return;
 
-    glm::vec3 size = node.max - node.min;
     int splitAxis = 0;
-    if (size.y > size.x && size.y > size.z)
-        splitAxis = 1;
-    else if (size.z > size.x && size.z > size.y)
-        splitAxis = 2;
+    float splitPos = 0.0f;
 
-    float splitPos = 0.5f * (node.min[splitAxis] + node.max[splitAxis]);
+    if (builder == BINNED_SAH)
+    {
+        if (!findSAHSplit(node, splitAxis, splitPos))
+            return;
+    }
+    else
+    {
+        glm::vec3 size = node.max - node.min;
+        if (size.y > size.x && size.y > size.z)
+            splitAxis = 1;
+        else if (size.z > size.x && size.z > size.y)
+            splitAxis = 2;
+
+        splitPos = 0.5f * (node.min[splitAxis] + node.max[splitAxis]);
+    }
 
     uint32_t begin = node.left;
     uint32_t end = begin + node.triangleCount;
@@ -63,8 +88,9 @@ void BVH::split(const uint32_t nodeIndex, const int depth)
 
     uint32_t leftIdx = nodes.size();
     nodes.emplace_back();
-    nodes.emplace_back();
+    nodes.emplace_back(); // may reallocate, `node` is dangling from here on
 
+    GPUNode &parent = nodes[nodeIndex];
     GPUNode &left = nodes[leftIdx];
     GPUNode &right = nodes[leftIdx + 1];
 
@@ -76,9 +102,9 @@ void BVH::split(const uint32_t nodeIndex, const int depth)
     right.right = 0;
     right.triangleCount = rightCount;
 
-    node.left = leftIdx;
-    node.right = leftIdx + 1;
-    node.triangleCount = 0;
+    parent.left = leftIdx;
+    parent.right = leftIdx + 1;
+    parent.triangleCount = 0;
 
     constexpr float numeric_max = std::numeric_limits<float>::max();
     left.min = glm::vec4(numeric_max);
@@ -95,6 +121,122 @@ void BVH::split(const uint32_t nodeIndex, const int depth)
     split(leftIdx + 1, depth + 1);
 }
 
+bool BVH::findSAHSplit(const GPUNode &node, int &axis, float &splitPos) const
+{
+    struct Bin
+    {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+    };
+
+    uint32_t begin = node.left;
+    uint32_t end = begin + node.triangleCount;
+
+    // bins span the centroids, not the triangles, so every bin can receive some
+    glm::vec3 centroidMin(std::numeric_limits<float>::max());
+    glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+    for (uint32_t i = begin; i < end; i++)
+    {
+        glm::vec3 center = centroid(triangles[i]);
+        centroidMin = glm::min(centroidMin, center);
+        centroidMax = glm::max(centroidMax, center);
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+
+    for (int a = 0; a < 3; a++)
+    {
+        float extent = centroidMax[a] - centroidMin[a];
+        if (extent <= 0.0f)
+            continue;
+
+        Bin bins[SAH_BINS];
+        float scale = SAH_BINS / extent;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const GPUTriangle &tri = triangles[i];
+            uint32_t b = std::min(SAH_BINS - 1, static_cast<uint32_t>((centroid(tri)[a] - centroidMin[a]) * scale));
+            bins[b].count++;
+            bins[b].min = glm::min(bins[b].min, glm::min(glm::vec3(tri.a), glm::min(glm::vec3(tri.b), glm::vec3(tri.c))));
+            bins[b].max = glm::max(bins[b].max, glm::max(glm::vec3(tri.a), glm::max(glm::vec3(tri.b), glm::vec3(tri.c))));
+        }
+
+        // sweep from the left, then from the right, split i is between bin i and i + 1
+        float leftCost[SAH_BINS - 1];
+        Bin left;
+        for (uint32_t i = 0; i < SAH_BINS - 1; i++)
+        {
+            left.count += bins[i].count;
+            left.min = glm::min(left.min, bins[i].min);
+            left.max = glm::max(left.max, bins[i].max);
+            leftCost[i] = left.count * surfaceArea(left.min, left.max);
+        }
+
+        Bin right;
+        for (uint32_t i = SAH_BINS - 1; i > 0; i--)
+        {
+            right.count += bins[i].count;
+            right.min = glm::min(right.min, bins[i].min);
+            right.max = glm::max(right.max, bins[i].max);
+
+            float cost = leftCost[i - 1] + right.count * surfaceArea(right.min, right.max);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                splitPos = centroidMin[a] + i / scale;
+            }
+        }
+    }
+
+    // unit traversal and intersection costs, splitting pays for one extra node visit
+    float parentArea = surfaceArea(node.min, node.max);
+    return bestCost < parentArea * (node.triangleCount - 1.0f);
+}
+
+void BVH::refit()
+{
+    constexpr float numeric_max = std::numeric_limits<float>::max();
+
+    // children are always appended after their parent, so walking backwards visits them first
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        GPUNode &node = nodes[i];
+        node.min = glm::vec4(numeric_max);
+        node.max = glm::vec4(-numeric_max);
+
+        if (node.triangleCount > 0)
+        {
+            for (uint32_t t = node.left; t < node.left + node.triangleCount; t++)
+                growToInclude(node, triangles[t]);
+        }
+        else
+        {
+            node.min = glm::min(nodes[node.left].min, nodes[node.right].min);
+            node.max = glm::max(nodes[node.left].max, nodes[node.right].max);
+        }
+    }
+}
+
+float BVH::sahCost() const
+{
+    if (nodes.empty())
+        return 0.0f;
+
+    float rootArea = surfaceArea(nodes[0].min, nodes[0].max);
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (const GPUNode &node : nodes)
+    {
+        float area = surfaceArea(node.min, node.max) / rootArea;
+        cost += node.triangleCount > 0 ? area * node.triangleCount : area;
+    }
+    return cost;
+}
+
 void BVH::growToInclude(GPUNode &node, glm::vec3 point)
 {
     node.min = glm::min(node.min, glm::vec4(point, 0));
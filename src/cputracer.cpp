@@ -0,0 +1,516 @@
+#include "cputracer.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    bool rayAABB(const glm::vec3 &origin, const glm::vec3 &invDir, const glm::vec4 &minB, const glm::vec4 &maxB, float maxDist)
+    {
+        glm::vec3 t0 = (glm::vec3(minB) - origin) * invDir;
+        glm::vec3 t1 = (glm::vec3(maxB) - origin) * invDir;
+
+        glm::vec3 tmin = glm::min(t0, t1);
+        glm::vec3 tmax = glm::max(t0, t1);
+
+        float tNear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+        float tFar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+
+        return tFar >= std::max(tNear, 0.0f) && tNear < maxDist;
+    }
+
+    glm::vec3 cosineHemisphereDirection(const glm::vec3 &normal, Sampler &sampler, uint32_t dimension)
+    {
+        float u1 = sampler.sample(dimension);
+        float u2 = sampler.sample(dimension + 1);
+
+        float r = std::sqrt(u1);
+        float theta = 2.0f * 3.1415926f * u2;
+
+        glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.1f ? glm::cross(glm::vec3(0, 1, 0), normal) : glm::cross(glm::vec3(1, 0, 0), normal));
+
+        return glm::normalize(
+            r * std::cos(theta) * tangent +
+            r * std::sin(theta) * glm::cross(normal, tangent) +
+            std::sqrt(1.0f - u1) * normal);
+    }
+}
+
+CPUTracer::CPUTracer(unsigned int width, unsigned int height, unsigned int threads)
+    : threadCount(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      width(width), height(height), accum(size_t(width) * height, PLACE_LOCAL),
+      sobolMatrices(buildSobolMatrices()),
+      nodeCounters(new NodeCounters[NumaTopology::get().nodeCount()])
+{
+}
+
+void CPUTracer::loadScene(const Scene &scene, BVH::Builder builder)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GPUTriangle> sceneTriangles;
+    std::vector<GPUMesh> gpuMeshes;
+    convertToGPUMeshes(scene, sceneTriangles, gpuMeshes);
+    convertMs = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    BVH bvh(sceneTriangles, builder);
+    bvhMs = msSince(start);
+
+    triangles = std::move(bvh.triangles);
+    nodes = std::move(bvh.nodes);
+    triangleCount = triangles.size();
+    nodeCount = nodes.size();
+
+    materials = scene.materials;
+    spheres = scene.spheres;
+    sphereMaterials.clear();
+    for (const GPUSphere &sphere : spheres)
+        sphereMaterials.push_back({sphere.color, sphere.smoothness, sphere.emission});
+
+    // specialize the tile kernel on what the scene actually contains
+    features = RaytracerFeatures::fromScene(scene, triangleCount, sceneData.maxBounce);
+
+    buildWideBVH();
+    placeScene();
+
+    resetAccumulation();
+}
+
+void CPUTracer::buildWideBVH()
+{
+    uint32_t width = wideBVHWidth(packetISA);
+
+    auto start = std::chrono::steady_clock::now();
+    wide4 = width == 4 ? WideBVH<4>(nodes, triangles) : WideBVH<4>();
+    wide8 = width == 8 ? WideBVH<8>(nodes, triangles) : WideBVH<8>();
+    wideWidth = width;
+    wideMs = msSince(start);
+}
+
+void CPUTracer::placeScene()
+{
+    // with one node a replica is the same as the local copy
+    unsigned int copyCount = placement == PLACE_REPLICATE ? NumaTopology::get().nodeCount() : 1;
+
+    copies.clear();
+    copies.resize(copyCount);
+    for (unsigned int node = 0; node < copyCount; node++)
+    {
+        SceneCopy &copy = copies[node];
+        copy.nodes = placedCopy(nodes, placement, node, hugePages);
+        copy.triangles = placedCopy(triangles, placement, node, hugePages);
+        copy.wide4.nodes = placedCopy(wide4.nodes, placement, node, hugePages);
+        copy.wide4.blocks = placedCopy(wide4.blocks, placement, node, hugePages);
+        copy.wide4.leaves = placedCopy(wide4.leaves, placement, node, hugePages);
+        copy.wide8.nodes = placedCopy(wide8.nodes, placement, node, hugePages);
+        copy.wide8.blocks = placedCopy(wide8.blocks, placement, node, hugePages);
+        copy.wide8.leaves = placedCopy(wide8.leaves, placement, node, hugePages);
+    }
+
+    placedAs = placement;
+    placedHugePages = hugePages;
+}
+
+void CPUTracer::resetAccumulation(uint32_t firstSample)
+{
+    frameIndex = 0;
+    sampleIndex = firstSample;
+}
+
+void CPUTracer::trace(const Camera &camera)
+{
+    trace(camera, 0, height);
+}
+
+void CPUTracer::trace(const Camera &camera, uint32_t firstRow, uint32_t lastRow)
+{
+    if (wideBVHWidth(packetISA) != wideWidth)
+    {
+        buildWideBVH(); // packetISA changed since loadScene
+        placeScene();
+    }
+    else if (copies.empty() || placement != placedAs || hugePages != placedHugePages)
+    {
+        placeScene();
+    }
+
+    selectKernel(); // maxBounce and packetISA may have changed since the last one
+
+    lastRow = std::min(lastRow, height);
+    firstRow = std::min(firstRow, lastRow);
+
+    uint32_t size = std::max(1u, tileSize);
+    uint32_t tilesX = (width + size - 1) / size;
+    uint32_t tilesY = (lastRow - firstRow + size - 1) / size;
+
+    scheduler.workerCpus = pinThreads ? NumaTopology::get().spreadCpus() : std::vector<unsigned int>();
+    scheduler.run(tilesX, tilesY, threadCount, [&](uint32_t tile, unsigned int)
+                  { (this->*tileKernel)(tile, size, firstRow, lastRow, camera); });
+
+    frameIndex++;
+    sampleIndex += sceneData.numRaysPerPixel;
+}
+
+uint64_t CPUTracer::nodeRays(unsigned int node) const
+{
+    return node < NumaTopology::get().nodeCount() ? nodeCounters[node].rays.load() : 0;
+}
+
+double CPUTracer::nodeMegaRaysPerSecond(unsigned int node) const
+{
+    return scheduler.wallMs() > 0.0 ? nodeRays(node) / (scheduler.wallMs() * 1e3) : 0.0;
+}
+
+void CPUTracer::resetStats()
+{
+    scheduler.resetStats();
+    for (unsigned int node = 0; node < NumaTopology::get().nodeCount(); node++)
+        nodeCounters[node].rays = 0;
+}
+
+void CPUTracer::printStats() const
+{
+    scheduler.printStats();
+
+    std::printf("%6s %14s %10s\n", "node", "rays", "Mrays/s");
+    for (unsigned int node = 0; node < NumaTopology::get().nodeCount(); node++)
+        std::printf("%6u %14llu %10.2f\n", node, (unsigned long long)nodeRays(node), nodeMegaRaysPerSecond(node));
+    std::printf("scene %s, %s pages, threads %s\n", placementName(placedAs),
+                !copies.empty() && copies[0].nodes.hugePages() ? "huge" : "small", pinThreads ? "pinned" : "unpinned");
+    std::printf("kernel %s\n", kernelName.c_str());
+}
+
+void CPUTracer::selectKernel()
+{
+    if (!specializedKernels || (!features.spheres && !features.triangles))
+    {
+        tileKernel = &CPUTracer::traceTile<GenericKernel>;
+        kernelName = "generic";
+        return;
+    }
+
+    if (!features.spheres)
+        tileKernel = selectWidth<FEATURE_OFF, FEATURE_ON>();
+    else if (!features.triangles)
+        tileKernel = selectWidth<FEATURE_ON, FEATURE_OFF>();
+    else
+        tileKernel = selectWidth<FEATURE_ON, FEATURE_ON>();
+
+    kernelName = features.spheres ? "spheres" : "";
+    if (features.triangles)
+        kernelName += std::string(features.spheres ? ", " : "") + (wideWidth ? "wide" + std::to_string(wideWidth) + " triangles" : "triangles");
+    kernelName += features.diffuseOnly ? ", diffuse only" : "";
+    kernelName += sceneData.maxBounce == COMPILED_BOUNCES ? ", " + std::to_string(COMPILED_BOUNCES) + " bounces" : "";
+}
+
+template <CPUTracer::KernelFeature SPHERES, CPUTracer::KernelFeature TRIANGLES>
+CPUTracer::TileKernel CPUTracer::selectWidth() const
+{
+    if constexpr (TRIANGLES == FEATURE_OFF)
+        return selectSmooth<SPHERES, TRIANGLES, 0>();
+    else if (wideWidth == 8)
+        return selectSmooth<SPHERES, TRIANGLES, 8>();
+    else if (wideWidth == 4)
+        return selectSmooth<SPHERES, TRIANGLES, 4>();
+    else
+        return selectSmooth<SPHERES, TRIANGLES, 0>();
+}
+
+template <CPUTracer::KernelFeature SPHERES, CPUTracer::KernelFeature TRIANGLES, uint32_t WIDTH>
+CPUTracer::TileKernel CPUTracer::selectSmooth() const
+{
+    if (features.diffuseOnly)
+        return selectBounces<SPHERES, TRIANGLES, WIDTH, FEATURE_OFF>();
+    return selectBounces<SPHERES, TRIANGLES, WIDTH, FEATURE_ON>();
+}
+
+template <CPUTracer::KernelFeature SPHERES, CPUTracer::KernelFeature TRIANGLES, uint32_t WIDTH, CPUTracer::KernelFeature SMOOTH>
+CPUTracer::TileKernel CPUTracer::selectBounces() const
+{
+    if (sceneData.maxBounce == COMPILED_BOUNCES)
+        return &CPUTracer::traceTile<Kernel<SPHERES, TRIANGLES, WIDTH, SMOOTH, COMPILED_BOUNCES>>;
+    return &CPUTracer::traceTile<Kernel<SPHERES, TRIANGLES, WIDTH, SMOOTH, AT_RUNTIME>>;
+}
+
+template <class K>
+void CPUTracer::traceTile(uint32_t tile, uint32_t size, uint32_t firstRow, uint32_t lastRow, const Camera &camera)
+{
+    uint32_t tilesX = (width + size - 1) / size;
+    uint32_t x0 = (tile % tilesX) * size;
+    uint32_t y0 = firstRow + (tile / tilesX) * size;
+    uint32_t x1 = std::min(x0 + size, width);
+    uint32_t y1 = std::min(y0 + size, lastRow);
+
+    glm::vec2 resolution(width, height);
+    glm::vec3 forward = glm::normalize(camera.cameraFront);
+    glm::vec3 right = glm::normalize(glm::cross(forward, camera.cameraUp));
+    glm::vec3 up = glm::cross(right, forward);
+    uint32_t seedHash = integerHash(seed);
+
+    // pinned workers stay on their node, unpinned ones read the replica of wherever they started
+    unsigned int node = NumaTopology::get().currentNode();
+    const SceneCopy &scene = copies[copies.size() > 1 ? node : 0];
+    BVHView bvh{scene.nodes.empty() ? nullptr : scene.nodes.data(), scene.triangles.data()};
+    uint64_t rayCount = 0;
+
+    for (uint32_t by = y0; by < y1; by += PACKET_BLOCK)
+    {
+        for (uint32_t bx = x0; bx < x1; bx += PACKET_BLOCK)
+        {
+            // -- Camera Rays --
+            RayPacket packet;
+            Ray rays[RayPacket::MAX_RAYS];
+            Collision primaries[RayPacket::MAX_RAYS];
+            uint32_t pixels[RayPacket::MAX_RAYS];
+
+            for (uint32_t y = by; y < std::min(by + PACKET_BLOCK, y1); y++)
+            {
+                for (uint32_t x = bx; x < std::min(bx + PACKET_BLOCK, x1); x++)
+                {
+                    glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / resolution;
+                    glm::vec2 screen = uv - 0.5f;
+                    screen.x *= resolution.x / resolution.y;
+
+                    uint32_t lane = packet.count++;
+                    Ray &ray = rays[lane];
+                    ray.origin = camera.cameraPos;
+                    ray.direction = glm::normalize(forward + screen.x * right + screen.y * up);
+                    ray.invDir = 1.0f / ray.direction;
+                    pixels[lane] = y * width + x;
+
+                    // spheres first, the packet then only looks for closer triangles
+                    if (K::spheres())
+                        raySpheres(ray, primaries[lane]);
+
+                    packet.ox[lane] = ray.origin.x;
+                    packet.oy[lane] = ray.origin.y;
+                    packet.oz[lane] = ray.origin.z;
+                    packet.dx[lane] = ray.direction.x;
+                    packet.dy[lane] = ray.direction.y;
+                    packet.dz[lane] = ray.direction.z;
+                    packet.tMax[lane] = primaries[lane].distance;
+                }
+            }
+
+            if (K::triangles(scene))
+            {
+                intersectPacket(packetISA, bvh, packet);
+                for (uint32_t lane = 0; lane < packet.count; lane++)
+                    if (packet.triangle[lane] != RayPacket::NO_HIT)
+                        triangleCollision(scene, rays[lane], packet.triangle[lane], packet.tMax[lane], primaries[lane]);
+            }
+            rayCount += packet.count;
+
+            // -- Paths --
+            for (uint32_t lane = 0; lane < packet.count; lane++)
+            {
+                uint32_t pixelIndex = pixels[lane];
+
+                Sampler sampler{samplerType, sobolMatrices.data(), 0, 0, integerHash(pixelIndex ^ seedHash)};
+
+                glm::vec3 totalLight(0);
+                for (uint32_t i = 0; i < sceneData.numRaysPerPixel; i++)
+                {
+                    sampler.index = sampleIndex + i;
+                    sampler.rng = integerHash(sampler.seed ^ integerHash(sampler.index)); // like the shader, per pixel and sample
+                    totalLight += tracePath<K>(scene, rays[lane], primaries[lane], sampler, rayCount);
+                }
+                totalLight /= float(sceneData.numRaysPerPixel);
+
+                glm::vec4 prev = frameIndex != 0 ? accum[pixelIndex] : glm::vec4(0);
+
+                // weighted by sample count so frames rendered at different spp average correctly
+                float samples = prev.w + float(sceneData.numRaysPerPixel);
+                float weight = float(sceneData.numRaysPerPixel) / samples;
+
+                accum[pixelIndex] = glm::vec4(glm::mix(glm::vec3(prev), totalLight, weight), samples);
+            }
+        }
+    }
+
+    nodeCounters[node].rays += rayCount;
+}
+
+template <class K>
+glm::vec3 CPUTracer::tracePath(const SceneCopy &scene, Ray ray, const Collision &primary, Sampler &sampler, uint64_t &rays) const
+{
+    glm::vec3 incomingLight(0);
+    glm::vec3 rayColor(1.0f);
+
+    for (uint32_t i = 0; i <= K::maxBounce(*this); i++)
+    {
+        if (std::max(rayColor.x, std::max(rayColor.y, rayColor.z)) < 0.0001f)
+            break;
+
+        Collision collision = i == 0 ? primary : calculateRayCollision<K>(scene, ray);
+        rays += i != 0;
+        if (!collision.didHit)
+            break; // no ambient light
+
+        const GPUMaterial &material = *collision.material;
+        ray.origin = collision.hitPoint + collision.normal * 0.0005f;
+
+        uint32_t dimension = i * DIMS_PER_BOUNCE;
+        glm::vec3 diffuseDir = cosineHemisphereDirection(collision.normal, sampler, dimension + DIM_HEMISPHERE);
+        if (K::smooth())
+        {
+            glm::vec3 specularDir = glm::reflect(ray.direction, collision.normal);
+            ray.direction = glm::normalize(glm::mix(diffuseDir, specularDir, material.smoothness));
+        }
+        else
+        {
+            ray.direction = diffuseDir;
+        }
+        ray.invDir = 1.0f / ray.direction;
+        incomingLight += glm::vec3(material.emission) * material.emission.w * rayColor;
+
+        rayColor *= material.color;
+
+        // russian roulette
+        float p = std::max(rayColor.x, std::max(rayColor.y, rayColor.z));
+        if (i > 2)
+        {
+            p = std::clamp(p, 0.05f, 0.95f);
+
+            if (sampler.sample(dimension + DIM_ROULETTE) > p)
+                break;
+
+            rayColor /= p;
+        }
+    }
+
+    return incomingLight;
+}
+
+template <class K>
+CPUTracer::Collision CPUTracer::calculateRayCollision(const SceneCopy &scene, const Ray &ray) const
+{
+    Collision closest;
+    if (K::spheres())
+        raySpheres(ray, closest);
+
+    if (!K::triangles(scene))
+        return closest;
+
+    // both start from the closest sphere, the shader only compares afterwards but the result is the same
+    uint32_t width = K::width(*this);
+    if (width == 0)
+    {
+        rayBVH(scene, ray, closest);
+        return closest;
+    }
+
+    float origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+    float direction[3] = {ray.direction.x, ray.direction.y, ray.direction.z};
+    float distance = closest.distance;
+    uint32_t triangle;
+    if (width == 8)
+        intersectWide(scene.wide8.view(), origin, direction, distance, triangle);
+    else
+        intersectWide(scene.wide4.view(), origin, direction, distance, triangle);
+
+    if (triangle != RayPacket::NO_HIT)
+        triangleCollision(scene, ray, triangle, distance, closest);
+    return closest;
+}
+
+void CPUTracer::raySpheres(const Ray &ray, Collision &closest) const
+{
+    for (size_t i = 0; i < spheres.size(); i++)
+    {
+        const GPUSphere &s = spheres[i];
+        glm::vec3 oc = s.position - ray.origin;
+
+        float closestApproach = glm::dot(oc, ray.direction);
+        if (closestApproach < 0)
+            continue; // sphere behind ray
+
+        float distRay2 = glm::dot(oc, oc) - closestApproach * closestApproach;
+        float r2 = s.radius * s.radius;
+        if (distRay2 > r2)
+            continue;
+
+        float distance = closestApproach - std::sqrt(r2 - distRay2);
+        if (distance >= closest.distance)
+            continue;
+
+        closest.didHit = true;
+        closest.distance = distance;
+        closest.hitPoint = ray.origin + ray.direction * distance;
+        closest.normal = (closest.hitPoint - s.position) / s.radius;
+        closest.material = &sphereMaterials[i];
+    }
+}
+
+void CPUTracer::rayBVH(const SceneCopy &scene, const Ray &ray, Collision &closest) const
+{
+    const BVH::GPUNode *nodes = scene.nodes.data();
+    const GPUTriangle *triangles = scene.triangles.data();
+
+    uint32_t stack[64];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = 0;
+
+    while (stackPtr > 0)
+    {
+        const BVH::GPUNode &node = nodes[stack[--stackPtr]];
+
+        if (node.triangleCount > 0)
+        {
+            // Moller-Trumbore, back faces are culled like in the shader
+            for (uint32_t i = 0; i < node.triangleCount; i++)
+            {
+                const GPUTriangle &tri = triangles[node.left + i];
+
+                glm::vec3 edge1 = tri.b - tri.a;
+                glm::vec3 edge2 = tri.c - tri.a;
+                glm::vec3 normalVec = glm::cross(edge1, edge2);
+                float det = -glm::dot(ray.direction, normalVec);
+                if (det < 1E-6f)
+                    continue;
+
+                float invdet = 1.0f / det;
+                glm::vec3 ao = ray.origin - tri.a;
+                glm::vec3 dao = glm::cross(ao, ray.direction);
+                float u = glm::dot(edge2, dao) * invdet;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+
+                float v = -glm::dot(edge1, dao) * invdet;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+
+                float dist = glm::dot(ao, normalVec) * invdet;
+                if (dist < 0.0f || dist >= closest.distance)
+                    continue;
+
+                triangleCollision(scene, ray, node.left + i, dist, closest);
+            }
+        }
+        else
+        {
+            bool hitLeft = rayAABB(ray.origin, ray.invDir, nodes[node.left].min, nodes[node.left].max, closest.distance);
+            bool hitRight = rayAABB(ray.origin, ray.invDir, nodes[node.right].min, nodes[node.right].max, closest.distance);
+
+            if (hitLeft && stackPtr < 64)
+                stack[stackPtr++] = node.left;
+            if (hitRight && stackPtr < 64)
+                stack[stackPtr++] = node.right;
+        }
+    }
+}
+
+void CPUTracer::triangleCollision(const SceneCopy &scene, const Ray &ray, uint32_t triangle, float distance, Collision &closest) const
+{
+    const GPUTriangle &tri = scene.triangles[triangle];
+
+    closest.didHit = true;
+    closest.distance = distance;
+    closest.hitPoint = ray.origin + ray.direction * distance;
+    closest.normal = glm::normalize(glm::cross(tri.b - tri.a, tri.c - tri.a));
+    closest.material = &materials[tri.materialIdx];
+}
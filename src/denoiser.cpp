@@ -0,0 +1,54 @@
+#include "denoiser.h"
+#include "texture.h"
+
+Denoiser::Denoiser(unsigned int width, unsigned int height) : width(width), height(height), shader("assets/denoise.comp")
+{
+    for (unsigned int &tex : pingPong)
+        tex = createImageTexture(width, height, GL_RGBA32F, GL_RGBA);
+
+    glUseProgram(shader.ID);
+    shader.setInt("colorTex", 0);
+    shader.setInt("depthTex", 1);
+    shader.setInt("normalTex", 2);
+    shader.setInt("albedoTex", 3);
+}
+
+Denoiser::~Denoiser()
+{
+    glDeleteTextures(2, pingPong);
+    glDeleteProgram(shader.ID);
+}
+
+unsigned int Denoiser::apply(unsigned int colorTex, unsigned int depthTex, unsigned int normalTex, unsigned int albedoTex)
+{
+    glUseProgram(shader.ID);
+    shader.setFloat("sigmaNormal", sigmaNormal);
+    shader.setFloat("sigmaDepth", sigmaDepth);
+    shader.setFloat("sigmaAlbedo", sigmaAlbedo);
+    shader.setFloat("sigmaLuminance", sigmaLuminance);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depthTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, normalTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, albedoTex);
+
+    unsigned int input = colorTex;
+    for (int i = 0; i < iterations; i++)
+    {
+        unsigned int output = pingPong[i % 2];
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, input);
+        glBindImageTexture(6, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        shader.setInt("stepSize", 1 << i);
+
+        shader.dispatch(width, height);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        input = output;
+    }
+
+    return input;
+}
@@ -0,0 +1,442 @@
+#include "distributed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "headless.h"
+#include "scenes.h"
+
+bool mergePartials(const std::vector<PartialImage> &partials, PartialImage &merged)
+{
+    if (partials.empty())
+    {
+        std::cerr << "Nothing to merge" << std::endl;
+        return false;
+    }
+
+    merged = PartialImage();
+    merged.width = partials[0].width;
+    merged.height = partials[0].height;
+    merged.firstRow = partials[0].firstRow;
+    merged.lastRow = partials[0].lastRow;
+    merged.firstSample = partials[0].firstSample;
+    merged.lastSample = partials[0].lastSample;
+
+    for (size_t i = 0; i < partials.size(); i++)
+    {
+        const PartialImage &a = partials[i];
+        if (a.width != merged.width || a.height != merged.height)
+        {
+            std::cerr << "Partial " << i << " is " << a.width << "x" << a.height << ", not " << merged.width << "x" << merged.height << std::endl;
+            return false;
+        }
+
+        // samples counted twice would still average to a plausible image, so they're an error
+        for (size_t j = 0; j < i; j++)
+        {
+            const PartialImage &b = partials[j];
+            bool rows = a.firstRow < b.lastRow && b.firstRow < a.lastRow;
+            bool samples = a.firstSample < b.lastSample && b.firstSample < a.lastSample;
+            if (rows && samples)
+            {
+                std::cerr << "Partials " << j << " and " << i << " both have samples "
+                          << std::max(a.firstSample, b.firstSample) << ":" << std::min(a.lastSample, b.lastSample) << " of rows "
+                          << std::max(a.firstRow, b.firstRow) << ":" << std::min(a.lastRow, b.lastRow) << std::endl;
+                return false;
+            }
+        }
+
+        merged.firstRow = std::min(merged.firstRow, a.firstRow);
+        merged.lastRow = std::max(merged.lastRow, a.lastRow);
+        merged.firstSample = std::min(merged.firstSample, a.firstSample);
+        merged.lastSample = std::max(merged.lastSample, a.lastSample);
+    }
+
+    // in doubles, so the order partials come in doesn't matter at float precision
+    std::vector<double> sums(size_t(merged.lastRow - merged.firstRow) * merged.width * 4, 0.0);
+    for (const PartialImage &partial : partials)
+    {
+        size_t offset = size_t(partial.firstRow - merged.firstRow) * merged.width * 4;
+        for (size_t i = 0; i < partial.sums.size(); i++)
+            sums[offset + i] += partial.sums[i];
+    }
+
+    merged.sums.assign(sums.begin(), sums.end());
+    return true;
+}
+
+namespace
+{
+    bool writeMerged(const PartialImage &merged, const std::vector<std::string> &outputs, const std::string &partialPath)
+    {
+        size_t empty = 0;
+        for (size_t i = 3; i < merged.sums.size(); i += 4)
+            if (merged.sums[i] <= 0.0f)
+                empty++;
+        if (merged.firstRow != 0 || merged.lastRow != merged.height)
+            std::cerr << "the partials only cover rows " << merged.firstRow << ":" << merged.lastRow << " of " << merged.height << std::endl;
+        if (empty != 0)
+            std::cerr << empty << " pixels have no samples" << std::endl;
+
+        if (!partialPath.empty())
+        {
+            if (!writePartial(partialPath, merged))
+                return false;
+            std::cout << "wrote " << partialPath << std::endl;
+        }
+
+        std::vector<float> pixels = accumulationFromPartial(merged);
+        for (const std::string &path : outputs)
+        {
+            if (!writeImage(path, merged.width, merged.height, pixels))
+                return false;
+            std::cout << "wrote " << path << std::endl;
+        }
+        return true;
+    }
+}
+
+int runMerge(int argc, char **argv)
+{
+    std::vector<std::string> inputs, outputs;
+    std::string partialPath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--merge")
+            continue;
+        if (arg == "--out" && i + 1 < argc)
+            outputs.push_back(argv[++i]);
+        else if (arg == "--partial" && i + 1 < argc)
+            partialPath = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            inputs.clear();
+            break;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (inputs.empty() || (outputs.empty() && partialPath.empty()))
+    {
+        std::cerr << "usage: engine --merge a.part b.part ... --out image.pfm|.hdr|.ppm [--out ...] [--partial merged.part]" << std::endl;
+        return -1;
+    }
+
+    std::vector<PartialImage> partials(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++)
+        if (!readPartial(inputs[i], partials[i]))
+            return -1;
+
+    PartialImage merged;
+    if (!mergePartials(partials, merged))
+        return -1;
+    std::cout << "merged " << partials.size() << " partials, samples " << merged.firstSample << ":" << merged.lastSample
+              << " at " << merged.width << "x" << merged.height << std::endl;
+    return writeMerged(merged, outputs, partialPath) ? 0 : -1;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <thread>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace
+{
+    static constexpr int MAX_ATTEMPTS = 2; // a range is retried once, then the render fails
+
+    struct Range
+    {
+        uint32_t first = 0, last = 0; // rows or samples
+        std::string path;             // its partial
+        int attempts = 0;
+    };
+
+    struct CoordinatorOptions
+    {
+        unsigned int workers = 1;
+        bool splitSamples = false; // --split samples
+        unsigned int ranges = 0;   // 0 = 4 per worker for rows, one per worker for samples
+        unsigned int height = HEADLESS_HEIGHT;
+        uint32_t spp = HEADLESS_SPP;
+        bool cpu = false;
+        bool threadsGiven = false;
+        std::vector<std::string> passed; // on to every worker
+        std::vector<std::string> outputs;
+        std::string partialPath;
+    };
+
+    void printUsage()
+    {
+        std::cerr << "usage: engine --distribute workers [--split rows|samples] [--ranges n] <engine --headless options>\n"
+                     "                                   --out image.pfm|.hdr|.ppm [--out ...] [--partial merged.part]"
+                  << std::endl;
+    }
+
+    bool parseOptions(int argc, char **argv, CoordinatorOptions &options)
+    {
+        std::string scene = "default";
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--stats" || arg == "--no-huge-pages" || arg == "--pin")
+            {
+                options.passed.push_back(arg);
+                continue;
+            }
+            if (arg == "--denoise")
+            {
+                std::cerr << "the denoiser needs every sample of the frame, writing the raw accumulation" << std::endl;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--distribute")
+                options.workers = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--split")
+            {
+                if (value != "rows" && value != "samples")
+                {
+                    std::cerr << "--split expects rows or samples" << std::endl;
+                    return false;
+                }
+                options.splitSamples = value == "samples";
+            }
+            else if (arg == "--ranges")
+                options.ranges = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--out")
+                options.outputs.push_back(value);
+            else if (arg == "--partial")
+                options.partialPath = value;
+            else if (arg == "--rows" || arg == "--samples")
+            {
+                std::cerr << arg << " is what the coordinator gives its workers" << std::endl;
+                return false;
+            }
+            else if (arg == "--backend" && value == "hybrid")
+            {
+                std::cerr << "--backend hybrid renders whole frames, it can't be distributed" << std::endl;
+                return false;
+            }
+            else
+            {
+                if (arg == "--height")
+                    options.height = std::max(1, std::atoi(value.c_str()));
+                else if (arg == "--spp")
+                    options.spp = std::max(1, std::atoi(value.c_str()));
+                else if (arg == "--backend")
+                    options.cpu = value == "cpu";
+                else if (arg == "--threads")
+                    options.threadsGiven = true;
+                else if (arg == "--scene")
+                    scene = value;
+
+                // the workers check the rest
+                options.passed.push_back(arg);
+                options.passed.push_back(value);
+            }
+        }
+
+        if (!findScene(scene))
+        {
+            std::cerr << "Unknown scene " << scene << std::endl;
+            return false;
+        }
+        if (options.outputs.empty() && options.partialPath.empty())
+        {
+            std::cerr << "No --out or --partial given" << std::endl;
+            return false;
+        }
+
+        uint32_t extent = options.splitSamples ? options.spp : options.height;
+        if (options.ranges == 0)
+            options.ranges = options.splitSamples ? options.workers : 4 * options.workers; // rows vary in cost, smaller ones balance
+        options.ranges = std::min(options.ranges, extent);
+        return true;
+    }
+
+    // The worker renders range into its partial, with its stdout (progress) silenced.
+    pid_t spawnWorker(const char *engine, const CoordinatorOptions &options, const Range &range)
+    {
+        std::vector<std::string> args = {engine, "--headless"};
+        args.insert(args.end(), options.passed.begin(), options.passed.end());
+        args.push_back(options.splitSamples ? "--samples" : "--rows");
+        args.push_back(std::to_string(range.first) + ":" + std::to_string(range.last));
+        args.push_back("--partial");
+        args.push_back(range.path);
+
+        // the workers share the cores, GPU workers share the GPU
+        if (options.cpu && !options.threadsGiven)
+        {
+            unsigned int threads = std::max(1u, std::thread::hardware_concurrency() / options.workers);
+            args.push_back("--threads");
+            args.push_back(std::to_string(threads));
+        }
+
+        std::vector<char *> argv;
+        for (std::string &arg : args)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+        pid_t pid = -1;
+        int error = posix_spawnp(&pid, engine, &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (error != 0)
+        {
+            std::cerr << "Failed to start " << engine << ": " << std::strerror(error) << std::endl;
+            return -1;
+        }
+        return pid;
+    }
+
+    void removePartials(const std::vector<Range> &ranges, const std::string &directory)
+    {
+        for (const Range &range : ranges)
+            std::remove(range.path.c_str());
+        rmdir(directory.c_str());
+    }
+}
+
+int runCoordinator(int argc, char **argv)
+{
+    CoordinatorOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return -1;
+    }
+
+    const char *tmp = std::getenv("TMPDIR");
+    std::string directory = std::string(tmp && *tmp ? tmp : "/tmp") + "/engine-distribute-XXXXXX";
+    if (!mkdtemp(directory.data()))
+    {
+        std::cerr << "Failed to create " << directory << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // -- Ranges -- even cuts, taken by whichever worker is free next
+    uint32_t extent = options.splitSamples ? options.spp : options.height;
+    std::vector<Range> ranges(options.ranges);
+    std::deque<size_t> pending;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        ranges[i].first = static_cast<uint32_t>(uint64_t(extent) * i / ranges.size());
+        ranges[i].last = static_cast<uint32_t>(uint64_t(extent) * (i + 1) / ranges.size());
+        ranges[i].path = directory + "/" + std::to_string(i) + ".part";
+        pending.push_back(i);
+    }
+
+    const char *what = options.splitSamples ? "samples " : "rows ";
+    std::cout << "distributing " << ranges.size() << " ranges of " << (options.splitSamples ? "samples" : "rows")
+              << " over " << options.workers << " workers" << std::endl;
+
+    // -- Workers --
+    auto start = std::chrono::steady_clock::now();
+    std::map<pid_t, std::pair<size_t, std::chrono::steady_clock::time_point>> running;
+    bool failed = false;
+    while (!running.empty() || (!pending.empty() && !failed))
+    {
+        while (!failed && !pending.empty() && running.size() < options.workers)
+        {
+            size_t index = pending.front();
+            pid_t pid = spawnWorker(argv[0], options, ranges[index]);
+            if (pid < 0)
+            {
+                failed = true;
+                break;
+            }
+            pending.pop_front();
+            ranges[index].attempts++;
+            running[pid] = {index, std::chrono::steady_clock::now()};
+        }
+        if (running.empty())
+            break;
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "waitpid: " << std::strerror(errno) << std::endl;
+            failed = true;
+            break;
+        }
+
+        auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+        Range &range = ranges[it->second.first];
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - it->second.second).count();
+        running.erase(it);
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            std::cout << what << range.first << ":" << range.last << " done in " << seconds << " s" << std::endl;
+            continue;
+        }
+
+        std::cerr << "the worker for " << what << range.first << ":" << range.last << " failed";
+        if (range.attempts < MAX_ATTEMPTS)
+        {
+            std::cerr << ", retrying" << std::endl;
+            pending.push_back(&range - ranges.data());
+        }
+        else
+        {
+            std::cerr << " again" << std::endl;
+            failed = true;
+        }
+    }
+
+    // -- Merge --
+    std::vector<PartialImage> partials(ranges.size());
+    for (size_t i = 0; i < ranges.size() && !failed; i++)
+        failed = !readPartial(ranges[i].path, partials[i]);
+
+    PartialImage merged;
+    bool ok = !failed && mergePartials(partials, merged);
+    removePartials(ranges, directory);
+    if (!ok)
+        return -1;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << merged.lastSample << " spp at " << merged.width << "x" << merged.height << " in " << seconds << " s ("
+              << options.workers << " workers)" << std::endl;
+    return writeMerged(merged, options.outputs, options.partialPath) ? 0 : -1;
+}
+
+#else
+
+int runCoordinator(int, char **)
+{
+    std::cerr << "--distribute needs POSIX processes" << std::endl;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "framebudget.h"
+
+#include <algorithm>
+#include <cmath>
+
+void FrameBudget::addTiming(float traceMs, float cpuFrameMs, uint32_t samples)
+{
+    if (samples == 0)
+        return;
+
+    // software drivers (llvmpipe) report 0 or 1 ns, the whole frame is a pessimistic stand in
+    float ms = traceMs > 1e-5f ? traceMs : cpuFrameMs;
+    float sampleMs = ms / samples;
+    msPerSample = msPerSample < 0.0f ? sampleMs : 0.8f * msPerSample + 0.2f * sampleMs;
+}
+
+bool FrameBudget::update()
+{
+    uint32_t total = samplesPerPixel * dispatches;
+    uint32_t target = 1;
+    if (enabled && msPerSample > 0.0f)
+    {
+        float budgetMs = traceShare * 1000.0f / targetFps;
+        float affordable = std::floor(budgetMs / msPerSample);
+        target = static_cast<uint32_t>(std::clamp(affordable, 1.0f, float(MAX_SAMPLES_PER_DISPATCH * MAX_DISPATCHES)));
+
+        // at most double or halve per frame, the timings lag behind by a few frames
+        target = std::clamp(target, std::max(total / 2, 1u), total * 2);
+    }
+
+    // fill one dispatch first, then spread the samples evenly over as few dispatches as possible
+    uint32_t newDispatches = (target + MAX_SAMPLES_PER_DISPATCH - 1) / MAX_SAMPLES_PER_DISPATCH;
+    uint32_t newSamples = (target + newDispatches - 1) / newDispatches;
+
+    bool changed = newSamples != samplesPerPixel;
+    samplesPerPixel = newSamples;
+    dispatches = newDispatches;
+    return changed;
+}
@@ -0,0 +1,414 @@
+#include "headless.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "offscreen.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "texture.h"
+#include "image.h"
+#include "cputracer.h"
+#include "hybrid.h"
+
+namespace
+{
+    struct HeadlessOptions
+    {
+        std::string scene = "default";
+        unsigned int width = HEADLESS_WIDTH;
+        unsigned int height = HEADLESS_HEIGHT;
+        uint32_t spp = HEADLESS_SPP;
+        uint32_t firstSample = 0;        // --samples, renders samples [firstSample, lastSample)
+        uint32_t lastSample = 0;         // 0 = spp
+        unsigned int firstRow = 0;       // --rows
+        unsigned int lastRow = 0;        // 0 = height
+        std::string partial;             // --partial, the ranges as a mergeable partial render
+        float orbit = 0.0f; // position on the scene's orbit, see orbitCamera
+        bool customCamera = false;
+        glm::vec3 position = glm::vec3(0);
+        float yaw = 0.0f, pitch = 0.0f;
+        SamplerType samplerType = SamplerType::SOBOL;
+        bool denoise = false;
+        bool cpu = false;          // --backend cpu
+        bool hybrid = false;       // --backend hybrid, the cpu options below apply to its cpu share
+        unsigned int threads = 0; // cpu backend, 0 = all hardware threads
+        PacketISA isa = bestPacketISA(); // cpu backend camera ray packets
+        unsigned int tileSize = 16;      // cpu backend
+        bool stats = false;              // print the cpu backend's per thread and per node stats
+        Placement placement = PLACE_LOCAL; // cpu backend scene data
+        bool hugePages = true;
+        bool pin = false;
+        std::vector<std::string> outputs;
+    };
+
+    void printUsage()
+    {
+        std::cerr << "usage: engine --headless [--scene name] [--width n] [--height n] [--spp n] [--orbit t | --camera x,y,z,yaw,pitch]\n"
+                     "                         [--sampler pcg|sobol] [--denoise] [--backend gpu|cpu|hybrid] [--threads n]\n"
+                     "                         [--isa scalar|sse|avx2|avx512] [--tile-size n] [--stats]\n"
+                     "                         [--numa local|interleave|replicate] [--no-huge-pages] [--pin]\n"
+                     "                         [--rows a:b] [--samples a:b] [--partial f.part]\n"
+                     "                         --out image.pfm|.hdr|.ppm [--out ...]\n"
+                     "scenes:";
+        for (const SceneDesc &desc : sceneRegistry())
+            std::cerr << " " << desc.name;
+        std::cerr << std::endl;
+    }
+
+    // a:b with a < b
+    bool parseRange(const std::string &value, uint32_t &first, uint32_t &last)
+    {
+        size_t colon = value.find(':');
+        if (colon == std::string::npos)
+            return false;
+        long a = std::atol(value.substr(0, colon).c_str());
+        long b = std::atol(value.substr(colon + 1).c_str());
+        if (a < 0 || b <= a)
+            return false;
+        first = static_cast<uint32_t>(a);
+        last = static_cast<uint32_t>(b);
+        return true;
+    }
+
+    bool wholeFrame(const HeadlessOptions &options)
+    {
+        return options.firstRow == 0 && options.lastRow == options.height && options.firstSample == 0;
+    }
+
+    bool parseOptions(int argc, char **argv, HeadlessOptions &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--headless")
+                continue;
+            if (arg == "--stats")
+            {
+                options.stats = true;
+                continue;
+            }
+            if (arg == "--denoise")
+            {
+                options.denoise = true;
+                continue;
+            }
+            if (arg == "--no-huge-pages")
+            {
+                options.hugePages = false;
+                continue;
+            }
+            if (arg == "--pin")
+            {
+                options.pin = true;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--scene")
+                options.scene = value;
+            else if (arg == "--width")
+                options.width = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--height")
+                options.height = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--spp")
+                options.spp = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--orbit")
+                options.orbit = std::strtof(value.c_str(), nullptr);
+            else if (arg == "--camera")
+            {
+                options.customCamera = true;
+                if (!parseCamera(value, options.position, options.yaw, options.pitch))
+                {
+                    std::cerr << "--camera expects x,y,z,yaw,pitch" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--sampler")
+            {
+                if (value == "pcg")
+                    options.samplerType = SamplerType::PCG;
+                else if (value == "sobol")
+                    options.samplerType = SamplerType::SOBOL;
+                else
+                {
+                    std::cerr << "--sampler expects pcg or sobol" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--out")
+                options.outputs.push_back(value);
+            else if (arg == "--partial")
+                options.partial = value;
+            else if (arg == "--rows")
+            {
+                if (!parseRange(value, options.firstRow, options.lastRow))
+                {
+                    std::cerr << "--rows expects first:end" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--samples")
+            {
+                if (!parseRange(value, options.firstSample, options.lastSample))
+                {
+                    std::cerr << "--samples expects first:end" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--backend")
+            {
+                if (value != "gpu" && value != "cpu" && value != "hybrid")
+                {
+                    std::cerr << "--backend expects gpu, cpu or hybrid" << std::endl;
+                    return false;
+                }
+                options.cpu = value == "cpu";
+                options.hybrid = value == "hybrid";
+            }
+            else if (arg == "--threads")
+                options.threads = std::max(0, std::atoi(value.c_str()));
+            else if (arg == "--tile-size")
+                options.tileSize = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "--numa")
+            {
+                if (value == "local")
+                    options.placement = PLACE_LOCAL;
+                else if (value == "interleave")
+                    options.placement = PLACE_INTERLEAVE;
+                else if (value == "replicate")
+                    options.placement = PLACE_REPLICATE;
+                else
+                {
+                    std::cerr << "--numa expects local, interleave or replicate" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--isa")
+            {
+                if (!parsePacketISA(value, options.isa) || !packetISASupported(options.isa))
+                {
+                    std::cerr << "--isa " << value << " isn't supported here, the best is " << packetISAName(bestPacketISA()) << std::endl;
+                    return false;
+                }
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+
+        if (!findScene(options.scene))
+        {
+            std::cerr << "Unknown scene " << options.scene << std::endl;
+            return false;
+        }
+        if (options.outputs.empty() && options.partial.empty())
+        {
+            std::cerr << "No --out or --partial given" << std::endl;
+            return false;
+        }
+        if (options.lastRow == 0 || options.lastRow > options.height)
+            options.lastRow = options.height;
+        if (options.firstRow >= options.lastRow)
+        {
+            std::cerr << "--rows " << options.firstRow << ":" << options.lastRow << " is outside the image" << std::endl;
+            return false;
+        }
+        if (options.lastSample == 0)
+            options.lastSample = options.spp; // --samples takes precedence, whatever order they came in
+        if (options.hybrid && !wholeFrame(options))
+        {
+            std::cerr << "--backend hybrid renders whole frames, not --rows or --samples" << std::endl;
+            return false;
+        }
+        if (options.denoise && (!wholeFrame(options) || !options.partial.empty()))
+        {
+            std::cerr << "the denoiser needs every sample of the frame, writing the raw accumulation" << std::endl;
+            options.denoise = false;
+        }
+        return true;
+    }
+
+    void configureCPU(const HeadlessOptions &options, CPUTracer &tracer)
+    {
+        tracer.samplerType = options.samplerType;
+        tracer.packetISA = options.isa;
+        tracer.tileSize = options.tileSize;
+        tracer.placement = options.placement;
+        tracer.hugePages = options.hugePages;
+        tracer.pinThreads = options.pin;
+    }
+
+    bool renderGPU(const HeadlessOptions &options, const Scene &scene, const Camera &camera, std::vector<float> &pixels)
+    {
+        // -- Context --
+        OffscreenContext context;
+        if (!context.create(options.width, options.height))
+            return false;
+
+        Renderer renderer(options.width, options.height);
+        renderer.reprojection = false;
+        renderer.denoiser.enabled = options.denoise;
+        renderer.samplerType = options.samplerType;
+        if (!renderer.loadScene(scene))
+            return false;
+        renderer.traceFirstRow = options.firstRow;
+        renderer.traceLastRow = options.lastRow;
+        renderer.resetAccumulation(options.firstSample);
+
+        if (options.hybrid)
+        {
+            if (options.denoise)
+                std::cerr << "the denoiser needs the GPU g-buffer of every row, writing the raw accumulation" << std::endl;
+
+            CPUTracer tracer(options.width, options.height, options.threads);
+            configureCPU(options, tracer);
+            tracer.loadScene(scene);
+
+            HybridTracer hybrid(renderer, tracer);
+            while (renderer.sampleIndex < options.lastSample)
+            {
+                hybrid.setSamplesPerPixel(std::min(MAX_SPP_PER_DISPATCH, options.lastSample - renderer.sampleIndex));
+                if (!hybrid.trace(camera, false))
+                    return false;
+            }
+            glFinish();
+
+            if (options.stats)
+            {
+                tracer.printStats();
+                std::printf("hybrid: cpu %u of %u rows, rows/ms gpu %.2f cpu %.2f\n", hybrid.cpuRows(), options.height,
+                            hybrid.gpuRowsPerMs(), hybrid.cpuRowsPerMs());
+            }
+
+            pixels = readImageTexture(renderer.accumTex, options.width, options.height);
+            return true;
+        }
+
+        // -- Render --
+        while (renderer.sampleIndex < options.lastSample)
+        {
+            renderer.setSamplesPerPixel(std::min(MAX_SPP_PER_DISPATCH, options.lastSample - renderer.sampleIndex));
+            if (!renderer.trace(camera, false))
+                return false;
+            glFinish();
+        }
+
+        pixels = readImageTexture(renderer.denoise(), options.width, options.height);
+        return true;
+    }
+
+    // no GL at all, works without any driver
+    bool renderCPU(const HeadlessOptions &options, const Scene &scene, const Camera &camera, std::vector<float> &pixels)
+    {
+        if (options.denoise)
+            std::cerr << "the denoiser is GPU only, writing the raw accumulation" << std::endl;
+
+        CPUTracer tracer(options.width, options.height, options.threads);
+        configureCPU(options, tracer);
+        tracer.loadScene(scene);
+        tracer.resetAccumulation(options.firstSample);
+
+        while (tracer.sampleIndex < options.lastSample)
+        {
+            tracer.setSamplesPerPixel(std::min(MAX_SPP_PER_DISPATCH, options.lastSample - tracer.sampleIndex));
+            tracer.trace(camera, options.firstRow, options.lastRow);
+        }
+
+        if (options.stats)
+            tracer.printStats();
+
+        pixels.resize(tracer.accum.size() * 4);
+        std::memcpy(pixels.data(), tracer.accum.data(), pixels.size() * sizeof(float));
+        return true;
+    }
+}
+
+bool parseCamera(const std::string &value, glm::vec3 &position, float &yaw, float &pitch)
+{
+    float v[5];
+    std::stringstream stream(value);
+    std::string item;
+    for (int i = 0; i < 5; i++)
+    {
+        if (!std::getline(stream, item, ','))
+            return false;
+        v[i] = std::strtof(item.c_str(), nullptr);
+    }
+
+    position = glm::vec3(v[0], v[1], v[2]);
+    yaw = v[3];
+    pitch = v[4];
+    return true;
+}
+
+int runHeadless(int argc, char **argv)
+{
+    HeadlessOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return -1;
+    }
+
+    const SceneDesc &desc = *findScene(options.scene);
+    Scene scene;
+    desc.build(scene);
+
+    Camera camera = options.customCamera ? Camera(90.0f, 6.0f, options.yaw, options.pitch, options.position)
+                                         : orbitCamera(desc, options.orbit);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<float> pixels;
+    bool ok = options.cpu ? renderCPU(options, scene, camera, pixels) : renderGPU(options, scene, camera, pixels);
+    if (!ok)
+        return -1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << options.scene << ": ";
+    if (wholeFrame(options))
+        std::cout << options.lastSample << " spp at " << options.width << "x" << options.height;
+    else
+        std::cout << "samples " << options.firstSample << ":" << options.lastSample << " of rows " << options.firstRow << ":"
+                  << options.lastRow << " at "
+                  << options.width << "x" << options.height;
+    std::cout << " in " << seconds << " s (" << (options.cpu ? std::string("cpu, ") + packetISAName(options.isa) : options.hybrid ? "hybrid" : "gpu") << ")" << std::endl;
+
+    // -- Output --
+    if (!options.partial.empty() || !wholeFrame(options))
+    {
+        PartialImage partial = partialFromAccumulation(options.width, options.height, pixels, options.firstRow,
+                                                       options.lastRow, options.firstSample, options.lastSample);
+        if (!options.partial.empty())
+        {
+            if (!writePartial(options.partial, partial))
+                return -1;
+            std::cout << "wrote " << options.partial << std::endl;
+        }
+        if (!wholeFrame(options))
+            pixels = accumulationFromPartial(partial); // the rows that weren't traced are black
+    }
+
+    for (const std::string &path : options.outputs)
+    {
+        if (!writeImage(path, options.width, options.height, pixels))
+            return -1;
+        std::cout << "wrote " << path << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "hybrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "timing.h"
+
+HybridTracer::HybridTracer(Renderer &renderer, CPUTracer &cpu) : renderer(renderer), cpu(cpu)
+{
+    // the CPU starts with one tile row, enough to measure it
+    split = renderer.height - std::min(tileRows(), renderer.height / 2);
+
+    for (Timing &timing : timings)
+    {
+        glGenQueries(2, timing.queries);
+        timing.rows = 0;
+        timing.pending = false;
+    }
+
+    glGenFramebuffers(1, &readFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer.accumTex, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    resetAccumulation();
+}
+
+HybridTracer::~HybridTracer()
+{
+    for (Timing &timing : timings)
+        glDeleteQueries(2, timing.queries);
+    glDeleteFramebuffers(1, &readFramebuffer);
+    renderer.traceLastRow = 0;
+}
+
+void HybridTracer::setSamplesPerPixel(uint32_t samples)
+{
+    renderer.setSamplesPerPixel(samples);
+    cpu.setSamplesPerPixel(samples);
+}
+
+void HybridTracer::resetAccumulation()
+{
+    renderer.resetAccumulation();
+    cpu.resetAccumulation();
+}
+
+uint32_t HybridTracer::tileRows() const
+{
+    return std::max(1u, cpu.tileSize);
+}
+
+bool HybridTracer::trace(const Camera &camera, bool cameraMoved)
+{
+    // the renderer's settings are the ones the UI and headless options change
+    cpu.samplerType = renderer.samplerType;
+    cpu.seed = renderer.seed;
+    cpu.sceneData.maxBounce = renderer.sceneData.maxBounce;
+    cpu.setSamplesPerPixel(renderer.sceneData.numRaysPerPixel);
+
+    // both must be at the same sample of every pixel, or rows changing sides would mix sequences
+    if (cameraMoved || cpu.frameIndex != renderer.frameIndex || cpu.sampleIndex != renderer.sampleIndex)
+        resetAccumulation();
+
+    collectGPUTimings();
+    rebalance();
+
+    // -- GPU Share -- runs while the CPU traces its own
+    Timing &timing = timings[current];
+    bool timed = !timing.pending; // otherwise every query is still in flight, this frame goes untimed
+    if (timed)
+        glQueryCounter(timing.queries[0], GL_TIMESTAMP);
+
+    renderer.traceLastRow = split;
+    if (!renderer.trace(camera, false))
+        return false;
+
+    if (timed)
+    {
+        glQueryCounter(timing.queries[1], GL_TIMESTAMP);
+        timing.rows = split;
+        timing.pending = true;
+        current = (current + 1) % FRAMES_IN_FLIGHT;
+    }
+    glFlush();
+
+    // -- CPU Share --
+    auto start = std::chrono::steady_clock::now();
+    cpu.trace(camera, split, renderer.height);
+    cpuMs = msSince(start);
+
+    if (cpuMs > 0.0)
+    {
+        double rate = cpuRows() / cpuMs;
+        cpuRate = cpuRate > 0.0 ? cpuRate + smoothing * (rate - cpuRate) : rate;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, renderer.accumTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, split, renderer.width, cpuRows(), GL_RGBA, GL_FLOAT,
+                    cpu.accum.data() + size_t(split) * renderer.width);
+    return true;
+}
+
+void HybridTracer::collectGPUTimings()
+{
+    // oldest first
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        Timing &timing = timings[(current + i) % FRAMES_IN_FLIGHT];
+        if (!timing.pending)
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(timing.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(timing.queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timing.queries[1], GL_QUERY_RESULT, &end);
+        timing.pending = false;
+
+        double ms = double(end - begin) * 1e-6;
+        if (end <= begin || timing.rows == 0)
+            continue;
+
+        double rate = timing.rows / ms;
+        gpuRate = gpuRate > 0.0 ? gpuRate + smoothing * (rate - gpuRate) : rate;
+    }
+}
+
+void HybridTracer::rebalance()
+{
+    uint32_t tile = tileRows();
+    uint32_t height = renderer.height;
+    if (gpuRate <= 0.0 || cpuRate <= 0.0 || height < 2 * tile)
+        return;
+
+    // rows are shared by throughput, within most of a tile row of that is close enough
+    double target = height * cpuRate / (cpuRate + gpuRate);
+    if (std::abs(target - cpuRows()) < 0.75 * tile)
+        return;
+
+    // whole tile rows, each side keeps at least one so both go on being measured
+    uint32_t rows = static_cast<uint32_t>(std::lround(target / tile)) * tile;
+    rows = std::clamp(rows, tile, height - tile);
+    uint32_t newSplit = height - rows;
+    if (newSplit == split)
+        return;
+
+    // rows the GPU gives up continue from its accumulation, the other way accumTex already has them
+    if (newSplit < split && cpu.frameIndex != 0)
+    {
+        glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glReadPixels(0, newSplit, renderer.width, split - newSplit, GL_RGBA, GL_FLOAT,
+                     cpu.accum.data() + size_t(newSplit) * renderer.width);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+    // rows the GPU takes back may have been the CPU's since the last reset, their g-buffer is older
+    if (newSplit > split)
+        renderer.invalidatePrimaryCache();
+    split = newSplit;
+}
@@ -0,0 +1,303 @@
+#include "image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+    bool littleEndian()
+    {
+        uint16_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    bool hasExtension(const std::string &path, const std::string &extension)
+    {
+        if (path.size() < extension.size())
+            return false;
+        std::string tail = path.substr(path.size() - extension.size());
+        std::transform(tail.begin(), tail.end(), tail.begin(), [](unsigned char c)
+                       { return std::tolower(c); });
+        return tail == extension;
+    }
+
+    // from the current position to the end, so sizes read from headers can be checked before allocating
+    long bytesLeft(FILE *file)
+    {
+        long position = std::ftell(file);
+        if (position < 0 || std::fseek(file, 0, SEEK_END) != 0)
+            return -1;
+        long end = std::ftell(file);
+        std::fseek(file, position, SEEK_SET);
+        return end - position;
+    }
+}
+
+bool writePFM(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba)
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+
+    // a negative scale marks little endian data, pfm rows are stored bottom to top like GL's
+    std::fprintf(file, "PF\n%u %u\n%s\n", width, height, littleEndian() ? "-1.0" : "1.0");
+
+    std::vector<float> rgb(size_t(width) * height * 3);
+    for (size_t i = 0; i < size_t(width) * height; i++)
+        for (int c = 0; c < 3; c++)
+            rgb[i * 3 + c] = rgba[i * 4 + c];
+
+    bool ok = std::fwrite(rgb.data(), sizeof(float), rgb.size(), file) == rgb.size();
+    std::fclose(file);
+    return ok;
+}
+
+bool readPFM(const std::string &path, unsigned int &width, unsigned int &height, std::vector<float> &rgba)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    char magic[3] = {};
+    float scale = 0.0f;
+    if (std::fscanf(file, "%2s %u %u %f", magic, &width, &height, &scale) != 4 || std::strcmp(magic, "PF") != 0)
+    {
+        std::cerr << "Not an RGB pfm: " << path << std::endl;
+        std::fclose(file);
+        return false;
+    }
+    std::fgetc(file); // the single whitespace before the data
+
+    if (width == 0 || height == 0 || uint64_t(width) * height * 3 * sizeof(float) > uint64_t(std::max(0L, bytesLeft(file))))
+    {
+        std::cerr << "Truncated pfm: " << path << std::endl;
+        std::fclose(file);
+        return false;
+    }
+
+    std::vector<float> rgb(size_t(width) * height * 3);
+    bool ok = std::fread(rgb.data(), sizeof(float), rgb.size(), file) == rgb.size();
+    std::fclose(file);
+    if (!ok)
+    {
+        std::cerr << "Truncated pfm: " << path << std::endl;
+        return false;
+    }
+
+    if ((scale < 0.0f) != littleEndian())
+    {
+        for (float &value : rgb)
+        {
+            uint8_t bytes[4];
+            std::memcpy(bytes, &value, 4);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+            std::memcpy(&value, bytes, 4);
+        }
+    }
+
+    rgba.assign(size_t(width) * height * 4, 1.0f);
+    for (size_t i = 0; i < size_t(width) * height; i++)
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = rgb[i * 3 + c];
+    return true;
+}
+
+bool writeHDR(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba)
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+
+    // flat (not run length encoded) scanlines, top to bottom
+    std::fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", height, width);
+
+    std::vector<uint8_t> scanline(size_t(width) * 4);
+    bool ok = true;
+    for (unsigned int y = height; y-- > 0;)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const float *pixel = &rgba[(size_t(y) * width + x) * 4];
+            float r = std::max(pixel[0], 0.0f), g = std::max(pixel[1], 0.0f), b = std::max(pixel[2], 0.0f);
+            float brightest = std::max(r, std::max(g, b));
+
+            uint8_t *rgbe = &scanline[size_t(x) * 4];
+            if (brightest < 1e-32f)
+            {
+                rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+                continue;
+            }
+
+            // shared exponent, the mantissas keep 8 bits relative to the brightest channel
+            int exponent;
+            float scale = std::frexp(brightest, &exponent) * 256.0f / brightest;
+            rgbe[0] = static_cast<uint8_t>(r * scale);
+            rgbe[1] = static_cast<uint8_t>(g * scale);
+            rgbe[2] = static_cast<uint8_t>(b * scale);
+            rgbe[3] = static_cast<uint8_t>(exponent + 128);
+        }
+        ok = ok && std::fwrite(scanline.data(), 1, scanline.size(), file) == scanline.size();
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+bool writePPM(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba)
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+
+    std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    std::vector<uint8_t> scanline(size_t(width) * 3);
+    bool ok = true;
+    for (unsigned int y = height; y-- > 0;) // ppm rows go top to bottom
+    {
+        for (unsigned int x = 0; x < width; x++)
+            for (int c = 0; c < 3; c++)
+                scanline[size_t(x) * 3 + c] = static_cast<uint8_t>(std::clamp(rgba[(size_t(y) * width + x) * 4 + c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        ok = ok && std::fwrite(scanline.data(), 1, scanline.size(), file) == scanline.size();
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+bool writeImage(const std::string &path, unsigned int width, unsigned int height, const std::vector<float> &rgba)
+{
+    if (hasExtension(path, ".pfm"))
+        return writePFM(path, width, height, rgba);
+    if (hasExtension(path, ".hdr"))
+        return writeHDR(path, width, height, rgba);
+    if (hasExtension(path, ".ppm"))
+        return writePPM(path, width, height, rgba);
+
+    std::cerr << "Unknown image format: " << path << " (use .pfm, .hdr or .ppm)" << std::endl;
+    return false;
+}
+
+PartialImage partialFromAccumulation(unsigned int width, unsigned int height, const std::vector<float> &rgba,
+                                     unsigned int firstRow, unsigned int lastRow, uint32_t firstSample, uint32_t lastSample)
+{
+    PartialImage partial;
+    partial.width = width;
+    partial.height = height;
+    partial.lastRow = std::min(lastRow, height);
+    partial.firstRow = std::min(firstRow, partial.lastRow);
+    partial.firstSample = firstSample;
+    partial.lastSample = lastSample;
+
+    size_t begin = size_t(partial.firstRow) * width * 4;
+    size_t end = size_t(partial.lastRow) * width * 4;
+    partial.sums.assign(rgba.begin() + begin, rgba.begin() + end);
+    for (size_t i = 0; i < partial.sums.size(); i += 4)
+        for (int c = 0; c < 3; c++)
+            partial.sums[i + c] *= partial.sums[i + 3];
+    return partial;
+}
+
+std::vector<float> accumulationFromPartial(const PartialImage &partial)
+{
+    std::vector<float> rgba(size_t(partial.width) * partial.height * 4, 0.0f);
+    size_t offset = size_t(partial.firstRow) * partial.width * 4;
+    for (size_t i = 0; i < partial.sums.size(); i += 4)
+    {
+        float count = partial.sums[i + 3];
+        for (int c = 0; c < 3; c++)
+            rgba[offset + i + c] = count > 0.0f ? partial.sums[i + c] / count : 0.0f;
+        rgba[offset + i + 3] = count;
+    }
+    return rgba;
+}
+
+bool writePartial(const std::string &path, const PartialImage &partial)
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+
+    // the scale works like a pfm's, its sign gives the byte order
+    std::fprintf(file, "RTPARTIAL\n%u %u\n%u %u\n%u %u\n%s\n", partial.width, partial.height, partial.firstRow,
+                 partial.lastRow, partial.firstSample, partial.lastSample, littleEndian() ? "-1.0" : "1.0");
+
+    bool ok = std::fwrite(partial.sums.data(), sizeof(float), partial.sums.size(), file) == partial.sums.size();
+    std::fclose(file);
+    return ok;
+}
+
+bool readPartial(const std::string &path, PartialImage &partial)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "Failed to read " << path << std::endl;
+        return false;
+    }
+
+    char magic[10] = {};
+    float scale = 0.0f;
+    int fields = std::fscanf(file, "%9s %u %u %u %u %u %u %f", magic, &partial.width, &partial.height, &partial.firstRow,
+                             &partial.lastRow, &partial.firstSample, &partial.lastSample, &scale);
+    if (fields != 8 || std::strcmp(magic, "RTPARTIAL") != 0 || partial.firstRow > partial.lastRow ||
+        partial.lastRow > partial.height || partial.firstSample > partial.lastSample)
+    {
+        std::cerr << "Not a partial render: " << path << std::endl;
+        std::fclose(file);
+        return false;
+    }
+    std::fgetc(file); // the single whitespace before the data
+
+    uint64_t bytes = uint64_t(partial.lastRow - partial.firstRow) * partial.width * 4 * sizeof(float);
+    // the whole frame is allocated on merging, no GL texture is larger than 64k a side
+    if (partial.width == 0 || partial.width > 65536 || partial.height > 65536 || bytes > uint64_t(std::max(0L, bytesLeft(file))))
+    {
+        std::cerr << "Truncated partial render: " << path << std::endl;
+        std::fclose(file);
+        return false;
+    }
+
+    partial.sums.resize(size_t(partial.lastRow - partial.firstRow) * partial.width * 4);
+    bool ok = std::fread(partial.sums.data(), sizeof(float), partial.sums.size(), file) == partial.sums.size();
+    std::fclose(file);
+    if (!ok)
+    {
+        std::cerr << "Truncated partial render: " << path << std::endl;
+        return false;
+    }
+
+    if ((scale < 0.0f) != littleEndian())
+    {
+        for (float &value : partial.sums)
+        {
+            uint8_t bytes[4];
+            std::memcpy(bytes, &value, 4);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+            std::memcpy(&value, bytes, 4);
+        }
+    }
+    return true;
+}
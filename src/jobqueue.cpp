@@ -0,0 +1,74 @@
+#include "jobqueue.h"
+
+#include <algorithm>
+
+namespace
+{
+    // heap order, true if a goes after b
+    bool later(const JobQueue::Entry &a, const JobQueue::Entry &b)
+    {
+        if (a.job.priority != b.job.priority)
+            return a.job.priority < b.job.priority;
+        if (a.job.deadline != b.job.deadline)
+            return a.job.deadline > b.job.deadline;
+        return a.order > b.order;
+    }
+
+    RenderResult failure(const std::string &error)
+    {
+        RenderResult result;
+        result.error = error;
+        return result;
+    }
+}
+
+std::future<RenderResult> JobQueue::push(RenderJob job)
+{
+    Entry entry;
+    entry.job = std::move(job);
+    std::future<RenderResult> future = entry.result.get_future();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed)
+    {
+        entry.result.set_value(failure(closeReason));
+        return future;
+    }
+
+    entry.order = pushed++;
+    heap.push_back(std::move(entry));
+    std::push_heap(heap.begin(), heap.end(), later);
+    ready.notify_one();
+    return future;
+}
+
+bool JobQueue::pop(Entry &entry, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!ready.wait_for(lock, timeout, [this]
+                        { return closed || !heap.empty(); }) ||
+        closed)
+        return false;
+
+    std::pop_heap(heap.begin(), heap.end(), later);
+    entry = std::move(heap.back());
+    heap.pop_back();
+    return true;
+}
+
+void JobQueue::close(const std::string &reason)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    closeReason = reason;
+    for (Entry &entry : heap)
+        entry.result.set_value(failure(reason));
+    heap.clear();
+    ready.notify_all();
+}
+
+size_t JobQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return heap.size();
+}
@@ -0,0 +1,81 @@
+#include "layouts.h"
+
+#include <cstddef>
+
+#include "object.h"
+#include "bvh.h"
+#include "camera.h"
+#include "stats.h"
+
+bool verifyGPULayouts(const Shader &raytracer)
+{
+    bool ok = true;
+
+    // -- Storage Blocks -- (std430 unless noted)
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "spheres[0].", sizeof(GPUSphere),
+                                {{"pos", offsetof(GPUSphere, position)},
+                                 {"radius", offsetof(GPUSphere, radius)},
+                                 {"material.color", offsetof(GPUSphere, color)},
+                                 {"material.smoothness", offsetof(GPUSphere, smoothness)},
+                                 {"material.emission", offsetof(GPUSphere, emission)}});
+
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "materials[0].", sizeof(GPUMaterial),
+                                {{"color", offsetof(GPUMaterial, color)},
+                                 {"smoothness", offsetof(GPUMaterial, smoothness)},
+                                 {"emission", offsetof(GPUMaterial, emission)}});
+
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "triangles[0].", sizeof(GPUTriangle),
+                                {{"a", offsetof(GPUTriangle, a)},
+                                 {"materialIdx", offsetof(GPUTriangle, materialIdx)},
+                                 {"b", offsetof(GPUTriangle, b)},
+                                 {"pad0", offsetof(GPUTriangle, pad0)},
+                                 {"c", offsetof(GPUTriangle, c)},
+                                 {"pad1", offsetof(GPUTriangle, pad1)}});
+
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "nodes[0].", sizeof(BVH::GPUNode),
+                                {{"min", offsetof(BVH::GPUNode, min)},
+                                 {"max", offsetof(BVH::GPUNode, max)},
+                                 {"left", offsetof(BVH::GPUNode, left)},
+                                 {"right", offsetof(BVH::GPUNode, right)},
+                                 {"triangleCount", offsetof(BVH::GPUNode, triangleCount)},
+                                 {"pad", offsetof(BVH::GPUNode, pad)}});
+
+    // std140, not an array so there is no stride to compare
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "sceneData.", 0,
+                                {{"maxBounce", offsetof(GPUSceneData, maxBounce)},
+                                 {"numRaysPerPixel", offsetof(GPUSceneData, numRaysPerPixel)}});
+
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "", sizeof(uint32_t),
+                                {{"sobolMatrices[0]", 0}});
+
+    ok &= raytracer.checkLayout(GL_BUFFER_VARIABLE, "pixelStats[0].", sizeof(GPUPixelStats),
+                                {{"nodes", offsetof(GPUPixelStats, nodes)},
+                                 {"aabbTests", offsetof(GPUPixelStats, aabbTests)},
+                                 {"triangleTests", offsetof(GPUPixelStats, triangleTests)},
+                                 {"rays", offsetof(GPUPixelStats, rays)},
+                                 {"bounces", offsetof(GPUPixelStats, bounces)},
+                                 {"paths", offsetof(GPUPixelStats, paths)},
+                                 {"maxNodes", offsetof(GPUPixelStats, maxNodes)},
+                                 {"pad", offsetof(GPUPixelStats, pad)}});
+
+    // -- Uniform Blocks -- (std140)
+    ok &= raytracer.checkLayout(GL_UNIFORM, "", 0,
+                                {{"cameraPos", offsetof(GPUCameraData, cameraPos)},
+                                 {"cameraFront", offsetof(GPUCameraData, cameraFront)},
+                                 {"cameraUp", offsetof(GPUCameraData, cameraUp)},
+                                 {"prevCameraPos", offsetof(GPUCameraData, prevCameraPos)},
+                                 {"prevCameraFront", offsetof(GPUCameraData, prevCameraFront)},
+                                 {"prevCameraUp", offsetof(GPUCameraData, prevCameraUp)}});
+
+    // -- Bindings --
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "Spheres", Binding::SPHERES);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "Materials", Binding::MATERIALS);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "Triangles", Binding::TRIANGLES);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "BVHNodes", Binding::BVH_NODES);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "Data", Binding::SCENE_DATA);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "SobolMatrices", Binding::SOBOL_MATRICES);
+    ok &= raytracer.checkBlockBinding(GL_SHADER_STORAGE_BLOCK, "TraversalStats", Binding::TRAVERSAL_STATS);
+    ok &= raytracer.checkBlockBinding(GL_UNIFORM_BLOCK, "CameraData", Binding::CAMERA_DATA);
+
+    return ok;
+}
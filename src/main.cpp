@@ -2,14 +2,23 @@
 #include <GLFW/glfw3.h> // ! Must be included after GLAD (due to method overriding).
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "camera.h"
 #include "shader.h"
 #include "window.h" //includes imgui imports
-#include "object.h"
-#include "bvh.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "framebudget.h"
+#include "profiler.h"
+#include "headless.h"
+#include "server.h"
+#include "distributed.h"
+#include "cputracer.h"
+#include "hybrid.h"
 
 #define SCR_WIDTH 1440
 #define SCR_HEIGHT 1080
@@ -20,16 +29,49 @@ float fps = 0.0f;
 
 Camera camera(90.0f, 6.0f, 0.0f, -40.0f, glm::vec3(-2, 7, 0)); // TODO: Implement fov.
 
-Window window(SCR_WIDTH, SCR_HEIGHT, "Window");
-uint32_t frameIndex = 0;
-
-Scene scene;
+bool cameraMoved = false;
 
 void mouseInput(GLFWwindow *window, double xposd, double yposd);
 void getInput(GLFWwindow *window);
 
-int main()
+int main(int argc, char **argv)
 {
+    bool autotune = false;   // time every work group shape and remember the fastest
+    bool cpuBackend = false; // trace on the CPU (see cputracer.h), the GPU only displays
+    bool hybrid = false;     // trace on both, see hybrid.h
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--headless")
+            return runHeadless(argc, argv); // batch render to a file, see headless.h
+        if (arg == "--serve")
+            return runServer(argc, argv); // render jobs from a socket, see server.h
+        if (arg == "--submit")
+            return runSubmit(argc, argv);
+        if (arg == "--distribute")
+            return runCoordinator(argc, argv); // one render over worker processes, see distributed.h
+        if (arg == "--merge")
+            return runMerge(argc, argv);
+        if (arg == "--autotune")
+            autotune = true;
+        else if (arg == "--backend")
+        {
+            std::string backend = i + 1 < argc ? argv[++i] : "";
+            if (backend != "gpu" && backend != "cpu" && backend != "hybrid")
+            {
+                std::cerr << "--backend expects gpu, cpu or hybrid\n"
+                             "usage: engine [--autotune] [--backend gpu|cpu|hybrid]\n"
+                             "       engine --headless | --serve | --submit | --distribute | --merge ..."
+                          << std::endl;
+                return -1;
+            }
+            cpuBackend = backend == "cpu" || backend == "hybrid";
+            hybrid = backend == "hybrid";
+        }
+    }
+
+    Window window(SCR_WIDTH, SCR_HEIGHT, "Window");
+
     // -- Settings --
     // glfwSetCursorPosCallback(window.window, mouseInput);
     glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -37,7 +79,6 @@ int main()
 
     // -- Shader --
     Shader pass("assets/pass.vert", "assets/pass.frag", ShaderType::PATH);
-    Shader raytracer("assets/raytracer.comp");
 
     float quad[] = {// using a quad so compute shader runs over every pixel on the screen
                     -1.f, -1.f,
@@ -59,123 +100,31 @@ int main()
     glEnableVertexAttribArray(0);
 
     // -- Object Instantiation --
-    scene.meshes.push_back(loadMesh("assets/models/dragon8k.obj", GPUMaterial{{1.f, 1.f, 1.f}, 0.1f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 2.f, 0.f}, {}, glm::vec3(4)}, scene.materials));
-    // scene.meshes.push_back(loadMesh("assets/models/teapot.obj", GPUMaterial{{1.f, 1.f, 1.f}, 0.1f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 2.f, 0.f}, {}, glm::vec3(4)}, scene.materials));
-    scene.meshes.push_back(loadRect({{{0, 0, -12.5f}, {0, 0, 0}, {40, .5f, 40}}, {{1, 1, 1}, 0.f, {0, 0, 0, 0}}}, scene));
-
-    { // creates a circle of spheres in a color wheel
-        int sides = 6;
-        float radius = 3.f;
-        float origin[2] = {5.5, 0.0};
-        for (int i = 0; i < sides; i++)
-        {
-            float angle = 2.0f * M_PI * i / sides + M_PI / 2.0f;
+    Scene scene;
+    findScene("default")->build(scene); // see scenes.cpp
 
-            float r = 0.5f + 0.5f * sin(angle);
-            float g = 0.5f + 0.5f * sin(angle + 2.0f * M_PI / 3.0f);
-            float b = 0.5f + 0.5f * sin(angle + 4.0f * M_PI / 3.0f);
+    Renderer renderer(SCR_WIDTH, SCR_HEIGHT);
+    if (!renderer.loadScene(scene))
+        return -1;
+    if (autotune && !renderer.autotune())
+        return -1;
 
-            // x (up), y, z (right)
-            scene.spheres.push_back({{radius * sin(angle) + origin[0], 1.5, radius * cos(angle) + origin[1]}, 1.0f, {0.f, 0.f, 0.f}, 0.f, {r, g, b, 1.f}});
-        }
-    }
+    FrameBudget frameBudget;
+    GPUProfiler profiler;
 
-    // scene.spheres.push_back({{5.5, 1.5, 0.f}, 1.0f, {1.f, 1.f, 1.f}, 0.f, {0.f, 0.f, 0.f, 0.0f}});
-    scene.spheres.push_back({{5.5, 8, 0.f}, 1.0f, {1.f, 1.f, 1.f}, 0.f, {1.f, 1.f, 1.f, 1.0f}});
-
-    // -- SSBO's --
-    uint32_t meshCount = scene.meshes.size();
-    uint32_t sphereCount = scene.spheres.size();
-
-    unsigned int sphereSSBO;
-    glGenBuffers(1, &sphereSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereSSBO);
-    glBufferData(
-        GL_SHADER_STORAGE_BUFFER,
-        sphereCount * sizeof(GPUSphere),
-        scene.spheres.data(),
-        GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereSSBO);
-
-    unsigned int matSSBO;
-    glGenBuffers(1, &matSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, matSSBO);
-    glBufferData(
-        GL_SHADER_STORAGE_BUFFER,
-        scene.materials.size() * sizeof(GPUMaterial),
-        scene.materials.data(),
-        GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, matSSBO);
-
-    std::vector<GPUTriangle> triangles;
-    std::vector<GPUMesh> gpuMeshes;
-    convertToGPUMeshes(scene, triangles, gpuMeshes);
-
-    BVH bvh(triangles); // bvh's the triangles
-
-    unsigned int triSSBO;
-    glGenBuffers(1, &triSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, triSSBO);
-    glBufferData(
-        GL_SHADER_STORAGE_BUFFER,
-        triangles.size() * sizeof(GPUTriangle),
-        triangles.data(),
-        GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, triSSBO);
-
-    unsigned int bvhSSBO;
-    glGenBuffers(1, &bvhSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhSSBO);
-    glBufferData(
-        GL_SHADER_STORAGE_BUFFER,
-        bvh.nodes.size() * sizeof(BVH::GPUNode),
-        bvh.nodes.data(),
-        GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bvhSSBO);
-
-    struct GPUSceneData
+    std::unique_ptr<CPUTracer> cpuTracer;
+    if (cpuBackend)
     {
-        uint32_t maxBounce;
-        uint32_t numRaysPerPixel;
-    } sceneData{5, 1}; // maxBounce, numRaysPerPixel
-
-    unsigned int dataSSBO;
-    glGenBuffers(1, &dataSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataSSBO);
-    glBufferData(
-        GL_SHADER_STORAGE_BUFFER,
-        sizeof(GPUSceneData),
-        &sceneData,
-        GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, dataSSBO);
-
-    // -- Frame Accumulation --
-
-    unsigned int accumTex;
-    glGenTextures(1, &accumTex);
-    glBindTexture(GL_TEXTURE_2D, accumTex);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA32F,
-        SCR_WIDTH,
-        SCR_HEIGHT,
-        0,
-        GL_RGBA,
-        GL_FLOAT,
-        nullptr);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glBindImageTexture(
-        0,
-        accumTex,
-        0,
-        GL_FALSE,
-        0,
-        GL_READ_WRITE,
-        GL_RGBA32F);
+        cpuTracer = std::make_unique<CPUTracer>(SCR_WIDTH, SCR_HEIGHT);
+        cpuTracer->loadScene(scene);
+        cpuTracer->samplerType = renderer.samplerType; // kept in step by the Sampler combo
+        frameBudget.enabled = false;       // budgets gpu time
+        renderer.denoiser.enabled = false; // needs the gpu g-buffer
+    }
+    std::unique_ptr<HybridTracer> hybridTracer;
+    if (hybrid)
+        hybridTracer = std::make_unique<HybridTracer>(renderer, *cpuTracer);
+    TraversalStats &traversalStats = renderer.traversalStats;
 
     // -- Render Loop --
     while (!glfwWindowShouldClose(window.window))
@@ -201,56 +150,166 @@ int main()
                          ImGuiWindowFlags_NoDecoration |
                          ImGuiWindowFlags_AlwaysAutoResize);
 
-        ImGui::Text("FPS: %.0f", fps);
-        ImGui::End();
-
-        // compute
-        glUseProgram(raytracer.ID);
+        ImGui::Text("FPS: %.0f%s", fps, hybridTracer ? " (hybrid)" : cpuTracer ? " (cpu)" : "");
+        ImGui::SameLine();
+        ImGui::Checkbox("Reprojection", &renderer.reprojection);
+        ImGui::SameLine();
+        ImGui::Checkbox("Denoise", &renderer.denoiser.enabled);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::SliderInt("Filter passes", &renderer.denoiser.iterations, 1, Denoiser::MAX_ITERATIONS);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        const char *samplerNames[] = {"PCG", "Sobol"};
+        int sampler = static_cast<int>(renderer.samplerType);
+        if (ImGui::Combo("Sampler", &sampler, samplerNames, 2))
+        {
+            renderer.samplerType = static_cast<SamplerType>(sampler);
+            renderer.resetAccumulation(); // don't mix the two estimators in one accumulation
+            if (cpuTracer && !hybridTracer) // the hybrid tracer takes the renderer's itself
+            {
+                cpuTracer->samplerType = renderer.samplerType;
+                cpuTracer->resetAccumulation();
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Frame budget", &frameBudget.enabled);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::SliderFloat("Target FPS", &frameBudget.targetFps, 10.0f, 240.0f, "%.0f");
+        ImGui::SameLine();
+        ImGui::Text("%u spp x %u", frameBudget.samplesPerPixel, frameBudget.dispatches);
+
+        // gpu timings, p50/p95/p99 over the last GPUProfiler::HISTORY frames
+        for (int pass = 0; pass < GPUProfiler::PASS_COUNT; pass++)
+        {
+            GPUProfiler::Pass p = static_cast<GPUProfiler::Pass>(pass);
+            if (pass != 0)
+                ImGui::SameLine();
+            ImGui::Text("%s %.2f/%.2f/%.2f ms", GPUProfiler::PASS_NAMES[pass],
+                        profiler.percentile(p, 0.5f), profiler.percentile(p, 0.95f), profiler.percentile(p, 0.99f));
+        }
+        ImGui::SameLine();
+        ImGui::Text("%.1f Mrays/s, %u spp total", profiler.megaRaysPerSecond(),
+                    cpuTracer && !hybridTracer ? cpuTracer->sampleIndex : renderer.sampleIndex);
+        ImGui::SameLine();
+        if (ImGui::Button("Export CSV"))
+            profiler.exportCSV("profile.csv");
+
+        ImGui::Checkbox("Traversal stats", &traversalStats.enabled);
+        if (traversalStats.enabled)
+        {
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::Combo("View", &traversalStats.view, TraversalStats::VIEW_NAMES, TraversalStats::VIEW_COUNT);
+            ImGui::SameLine();
+            ImGui::Text("nodes/ray %.1f (max %u), aabb tests/ray %.1f, triangle tests/ray %.1f, bounces/path %.2f",
+                        traversalStats.nodesPerRay, traversalStats.maxNodes, traversalStats.aabbTestsPerRay,
+                        traversalStats.triangleTestsPerRay, traversalStats.bouncesPerPath);
+        }
 
-        glUniform1ui(
-            glGetUniformLocation(raytracer.ID, "frameIndex"),
-            frameIndex);
+        if (cpuTracer)
+        {
+            // scheduler stats since the tile size last changed
+            int tileSize = cpuTracer->tileSize;
+            ImGui::SetNextItemWidth(120.0f);
+            if (ImGui::SliderInt("Tile size", &tileSize, 4, 64))
+            {
+                cpuTracer->tileSize = tileSize;
+                cpuTracer->resetStats();
+            }
+
+            const TileScheduler &scheduler = cpuTracer->scheduler;
+            double minUtilization = 1.0, sumUtilization = 0.0;
+            unsigned long long steals = 0;
+            for (size_t w = 0; w < scheduler.workerStats().size(); w++)
+            {
+                minUtilization = std::min(minUtilization, scheduler.utilization(w));
+                sumUtilization += scheduler.utilization(w);
+                steals += scheduler.workerStats()[w].steals;
+            }
+            ImGui::SameLine();
+            ImGui::Text("%zu threads, utilization min %.0f%% avg %.0f%%, %llu steals", scheduler.workerStats().size(),
+                        100.0 * minUtilization, 100.0 * sumUtilization / std::max<size_t>(1, scheduler.workerStats().size()), steals);
+
+            // one line per NUMA node, rays traced by the threads running there
+            for (unsigned int node = 0; node < NumaTopology::get().nodeCount(); node++)
+                ImGui::Text("node %u: %.1f Mrays/s", node, cpuTracer->nodeMegaRaysPerSecond(node));
+
+            if (hybridTracer)
+                ImGui::Text("hybrid: cpu %u of %u rows, rows/ms gpu %.1f cpu %.1f", hybridTracer->cpuRows(), SCR_HEIGHT,
+                            hybridTracer->gpuRowsPerMs(), hybridTracer->cpuRowsPerMs());
+        }
+        ImGui::End();
 
-        raytracer.setVec3("cameraPos", camera.cameraPos);
-        raytracer.setVec3("cameraFront", camera.cameraFront);
-        raytracer.setVec3("cameraUp", camera.cameraUp);
-        raytracer.setFloat("fov", camera.fov);
+        // frame budget, the accumulation weighs by sample count so spp can change at any time
+        for (const GPUProfiler::FrameTiming &timing : profiler.takeFinished())
+            frameBudget.addTiming(timing.passMs[GPUProfiler::TRACE], timing.cpuMs, timing.samples);
+        if (frameBudget.update())
+            renderer.setSamplesPerPixel(frameBudget.samplesPerPixel);
 
-        glUniform1ui(
-            glGetUniformLocation(raytracer.ID, "sphereCount"),
-            sphereCount);
+        // compute
+        profiler.begin(GPUProfiler::TRACE);
+        if (hybridTracer)
+        {
+            if (!hybridTracer->trace(camera, cameraMoved))
+                return -1;
+        }
+        else if (cpuTracer)
+        {
+            if (cameraMoved)
+                cpuTracer->resetAccumulation();
+            cpuTracer->trace(camera);
 
-        glDispatchCompute(
-            (SCR_WIDTH + 7) / 16,
-            (SCR_HEIGHT + 7) / 16,
-            1);
+            // same layout as the gpu accumulation, so everything after this is shared
+            glBindTexture(GL_TEXTURE_2D, renderer.accumTex);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_FLOAT, cpuTracer->accum.data());
+        }
+        else if (!renderer.trace(camera, cameraMoved, frameBudget.dispatches))
+            return -1;
+        profiler.end(GPUProfiler::TRACE);
+        cameraMoved = false;
 
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // needed for shared frames
+        unsigned int displayTex = renderer.accumTex;
+        if (renderer.denoiser.enabled && !cpuTracer)
+        {
+            profiler.begin(GPUProfiler::DENOISE);
+            displayTex = renderer.denoise();
+            profiler.end(GPUProfiler::DENOISE);
+        }
 
         // start draw
         ImGui::Render();
 
+        profiler.begin(GPUProfiler::DISPLAY);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT);
 
         glUseProgram(pass.ID);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, accumTex);
-        glUniform1i(glGetUniformLocation(pass.ID, "accumTex"), 0);
+        glBindTexture(GL_TEXTURE_2D, displayTex);
+        pass.setInt("accumTex", 0);
+
+        int view = traversalStats.enabled ? traversalStats.view : TraversalStats::COLOR;
+        pass.setInt("view", view);
+        pass.setFloat("viewMax", traversalStats.viewMax[view]);
 
         glBindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        profiler.end(GPUProfiler::DISPLAY);
 
-        frameIndex++; // * Comment out to disable accumulation
-
+        profiler.begin(GPUProfiler::UI);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end(GPUProfiler::UI);
+
+        uint32_t frameSamples = frameBudget.samplesPerPixel * frameBudget.dispatches;
+        profiler.endFrame(deltaTime * 1000.0f, frameSamples, uint64_t(SCR_WIDTH) * SCR_HEIGHT * frameSamples);
         glfwSwapBuffers(window.window);
     }
 
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &quadVBO);
-    glDeleteProgram(raytracer.ID);
 
     return 0;
 }
@@ -285,7 +344,7 @@ void mouseInput(GLFWwindow *window, double xposd, double yposd)
     camera.normalize();
 
     if (xoffset != 0.0f || yoffset != 0.0f)
-        frameIndex = 0;
+        cameraMoved = true;
 }
 
 void getInput(GLFWwindow *window)
@@ -302,5 +361,5 @@ void getInput(GLFWwindow *window)
     if (camera.cameraPos != oldPos ||
         camera.yaw != oldYaw ||
         camera.pitch != oldPitch)
-        frameIndex = 0;
+        cameraMoved = true;
 }
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+    // from linux/mempolicy.h
+    constexpr int MPOL_PREFERRED_MODE = 1;
+    constexpr int MPOL_INTERLEAVE_MODE = 3;
+
+    // "0-3,8-11" to {0, 1, 2, 3, 8, 9, 10, 11}
+    std::vector<unsigned int> parseCpuList(const std::string &list)
+    {
+        std::vector<unsigned int> cpus;
+        std::stringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            if (range.empty() || range == "\n")
+                continue;
+            size_t dash = range.find('-');
+            unsigned int first = std::stoul(range.substr(0, dash));
+            unsigned int last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for (unsigned int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    void bindMemory(void *ptr, size_t bytes, Placement placement, unsigned int node, unsigned int nodeCount)
+    {
+        if (placement == PLACE_LOCAL || nodeCount < 2)
+            return;
+
+        std::vector<unsigned long> mask((nodeCount + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)), 0);
+        auto set = [&](unsigned int n)
+        { mask[n / (8 * sizeof(unsigned long))] |= 1ul << (n % (8 * sizeof(unsigned long))); };
+
+        int mode = MPOL_PREFERRED_MODE; // falls back to other nodes when this one is full
+        if (placement == PLACE_INTERLEAVE)
+        {
+            mode = MPOL_INTERLEAVE_MODE;
+            for (unsigned int n = 0; n < nodeCount; n++)
+                set(n);
+        }
+        else
+        {
+            set(std::min(node, nodeCount - 1));
+        }
+
+        // best effort, a kernel without NUMA support leaves the pages local
+        syscall(SYS_mbind, ptr, bytes, mode, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0);
+    }
+#endif
+}
+
+const char *placementName(Placement placement)
+{
+    const char *names[] = {"local", "interleave", "replicate"};
+    return placement >= PLACE_LOCAL && placement <= PLACE_REPLICATE ? names[placement] : "unknown";
+}
+
+// -- NumaTopology --
+
+const NumaTopology &NumaTopology::get()
+{
+    static const NumaTopology topology = []()
+    {
+        NumaTopology result;
+#ifdef __linux__
+        for (unsigned int node = 0;; node++)
+        {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file)
+                break;
+            std::string list;
+            std::getline(file, list);
+            result.nodeCpus.push_back(parseCpuList(list));
+        }
+#endif
+        if (result.nodeCpus.empty())
+        {
+            result.nodeCpus.emplace_back();
+            for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+                result.nodeCpus[0].push_back(cpu);
+        }
+
+        for (unsigned int node = 0; node < result.nodeCpus.size(); node++)
+        {
+            for (unsigned int cpu : result.nodeCpus[node])
+            {
+                if (cpu >= result.cpuNode.size())
+                    result.cpuNode.resize(cpu + 1, -1);
+                result.cpuNode[cpu] = node;
+            }
+        }
+        return result;
+    }();
+    return topology;
+}
+
+unsigned int NumaTopology::currentNode() const
+{
+#ifdef __linux__
+    if (nodeCount() < 2)
+        return 0;
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && size_t(cpu) < cpuNode.size() && cpuNode[cpu] >= 0)
+        return cpuNode[cpu];
+#endif
+    return 0;
+}
+
+std::vector<unsigned int> NumaTopology::spreadCpus() const
+{
+    std::vector<unsigned int> cpus;
+    for (size_t i = 0;; i++)
+    {
+        size_t added = 0;
+        for (const std::vector<unsigned int> &node : nodeCpus)
+        {
+            if (i < node.size())
+            {
+                cpus.push_back(node[i]);
+                added++;
+            }
+        }
+        if (added == 0)
+            return cpus;
+    }
+}
+
+// -- ThreadPin --
+
+ThreadPin::ThreadPin(unsigned int cpu)
+{
+#ifdef __linux__
+    cpu_set_t old;
+    if (sched_getaffinity(0, sizeof(old), &old) != 0 || cpu >= CPU_SETSIZE)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return;
+
+    previous.resize(sizeof(old));
+    std::memcpy(previous.data(), &old, sizeof(old));
+    pinned = true;
+#else
+    (void)cpu;
+#endif
+}
+
+ThreadPin::~ThreadPin()
+{
+#ifdef __linux__
+    if (!pinned)
+        return;
+    cpu_set_t old;
+    std::memcpy(&old, previous.data(), sizeof(old));
+    sched_setaffinity(0, sizeof(old), &old);
+#endif
+}
+
+// -- PlacedBuffer --
+
+PlacedBuffer::PlacedBuffer(size_t bytes, Placement placement, unsigned int node, bool hugePages) : bytes(bytes)
+{
+    if (bytes == 0)
+        return;
+
+#ifdef __linux__
+    // huge pages need 2MB aligned ranges, small buffers aren't worth a whole one
+    hugePages = hugePages && bytes >= HUGE_PAGE;
+    size_t alignment = hugePages ? HUGE_PAGE : 0;
+
+    mappingBytes = bytes + alignment;
+    mapping = mmap(nullptr, mappingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        mappingBytes = 0;
+    }
+    else
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(mapping);
+        if (alignment)
+            address = (address + alignment - 1) & ~(alignment - 1);
+        ptr = reinterpret_cast<void *>(address);
+
+        huge = hugePages && madvise(ptr, bytes, MADV_HUGEPAGE) == 0;
+        bindMemory(ptr, bytes, placement, node, NumaTopology::get().nodeCount());
+        return;
+    }
+#else
+    (void)placement;
+    (void)node;
+    (void)hugePages;
+#endif
+
+    // anonymous mappings are zero filled, the heap has to be cleared
+    ptr = ::operator new(bytes, std::align_val_t(64));
+    std::memset(ptr, 0, bytes);
+}
+
+PlacedBuffer::~PlacedBuffer()
+{
+    release();
+}
+
+PlacedBuffer::PlacedBuffer(PlacedBuffer &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+PlacedBuffer &PlacedBuffer::operator=(PlacedBuffer &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    release();
+    ptr = other.ptr;
+    bytes = other.bytes;
+    mapping = other.mapping;
+    mappingBytes = other.mappingBytes;
+    huge = other.huge;
+
+    other.ptr = nullptr;
+    other.bytes = 0;
+    other.mapping = nullptr;
+    other.mappingBytes = 0;
+    other.huge = false;
+    return *this;
+}
+
+void PlacedBuffer::release()
+{
+#ifdef __linux__
+    if (mapping)
+        munmap(mapping, mappingBytes);
+#endif
+    if (!mapping && ptr)
+        ::operator delete(ptr, std::align_val_t(64));
+
+    ptr = nullptr;
+    mapping = nullptr;
+}
@@ -0,0 +1,100 @@
+#include "offscreen.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef HAS_EGL
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR ((EGLConfig)0)
+#endif
+#endif
+
+OffscreenContext::~OffscreenContext()
+{
+#ifdef HAS_EGL
+    if (display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+#endif
+}
+
+bool OffscreenContext::create(unsigned int width, unsigned int height)
+{
+#ifdef HAS_EGL
+    if (createSurfaceless())
+        return true;
+#endif
+
+    std::cerr << "no surfaceless EGL context, using a hidden window" << std::endl;
+    window = std::make_unique<Window>(width, height, "engine", false);
+    return window->window != nullptr;
+}
+
+#ifdef HAS_EGL
+bool OffscreenContext::createSurfaceless()
+{
+    // the surfaceless platform needs neither a display server nor a GPU, fall back to the default display
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        return fail("eglInitialize");
+
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        std::cerr << "EGL: EGL_KHR_surfaceless_context is not supported" << std::endl;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return fail("eglBindAPI");
+
+    // surfaceless displays may not expose any config, a context doesn't need one with no_config_context
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!std::strstr(extensions, "EGL_KHR_no_config_context"))
+    {
+        EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+            return fail("eglChooseConfig");
+    }
+
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT)
+        return fail("eglCreateContext");
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        return fail("eglMakeCurrent");
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        std::cerr << "Failed to initialize GLAD\n";
+        return false;
+    }
+    return true;
+}
+
+bool OffscreenContext::fail(const char *call)
+{
+    std::cerr << "EGL: " << call << " failed (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+    return false;
+}
+#endif
@@ -0,0 +1,139 @@
+#include "packet.h"
+#include "packet_kernel.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace
+{
+    const char *ISA_NAMES[ISA_COUNT] = {"scalar", "sse", "avx2", "avx512"};
+
+    bool cpuSupports(PacketISA isa)
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 1);
+        bool sse2 = info[3] & (1 << 26);
+        bool osxsave = info[2] & (1 << 27);
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;      // ymm state saved by the os
+        bool avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6; // zmm and mask state too
+
+        switch (isa)
+        {
+        case ISA_SSE:
+            return sse2;
+        case ISA_AVX2:
+            return avx2;
+        case ISA_AVX512:
+            return avx512;
+        default:
+            return true;
+        }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        switch (isa)
+        {
+        case ISA_SSE:
+            return __builtin_cpu_supports("sse2");
+        case ISA_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case ISA_AVX512:
+            return __builtin_cpu_supports("avx512f");
+        default:
+            return true;
+        }
+#else
+        return isa == ISA_SCALAR;
+#endif
+    }
+
+    PacketKernel kernel(PacketISA isa)
+    {
+        switch (isa)
+        {
+        case ISA_SSE:
+            return packetKernelSSE();
+        case ISA_AVX2:
+            return packetKernelAVX2();
+        case ISA_AVX512:
+            return packetKernelAVX512();
+        default:
+            return nullptr;
+        }
+    }
+}
+
+const char *packetISAName(PacketISA isa)
+{
+    return isa >= 0 && isa < ISA_COUNT ? ISA_NAMES[isa] : "unknown";
+}
+
+bool parsePacketISA(const std::string &name, PacketISA &isa)
+{
+    for (int i = 0; i < ISA_COUNT; i++)
+    {
+        if (name == ISA_NAMES[i])
+        {
+            isa = static_cast<PacketISA>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t packetWidth(PacketISA isa)
+{
+    const uint32_t widths[ISA_COUNT] = {1, 4, 8, 16};
+    return isa >= 0 && isa < ISA_COUNT ? widths[isa] : 1;
+}
+
+bool packetISASupported(PacketISA isa)
+{
+    if (isa == ISA_SCALAR)
+        return true;
+    return kernel(isa) != nullptr && cpuSupports(isa);
+}
+
+PacketISA bestPacketISA()
+{
+    // checked once, the cpu doesn't change
+    static const PacketISA best = []()
+    {
+        for (int i = ISA_COUNT - 1; i > ISA_SCALAR; i--)
+            if (packetISASupported(static_cast<PacketISA>(i)))
+                return static_cast<PacketISA>(i);
+        return ISA_SCALAR;
+    }();
+    return best;
+}
+
+void intersectPacket(PacketISA isa, const BVHView &bvh, RayPacket &packet)
+{
+    for (uint32_t i = 0; i < packet.count; i++)
+        packet.triangle[i] = RayPacket::NO_HIT;
+
+    if (packet.count == 0 || !bvh.nodes)
+        return;
+
+    PacketKernel group = packetISASupported(isa) ? kernel(isa) : nullptr;
+    if (group)
+    {
+        uint32_t width = packetWidth(isa);
+        for (uint32_t first = 0; first < packet.count; first += width)
+            group(bvh, packet, first);
+        return;
+    }
+
+    for (uint32_t i = 0; i < packet.count; i++)
+    {
+        float o[3] = {packet.ox[i], packet.oy[i], packet.oz[i]};
+        float d[3] = {packet.dx[i], packet.dy[i], packet.dz[i]};
+        float inv[3] = {1.0f / d[0], 1.0f / d[1], 1.0f / d[2]};
+
+        // the root box isn't tested, like in rayBVH
+        intersectLane(bvh, 0, o, d, inv, packet.tMax[i], packet.triangle[i]);
+    }
+}
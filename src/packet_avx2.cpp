@@ -0,0 +1,29 @@
+// packet and wide BVH kernels for AVX2, this file alone is compiled with AVX2 enabled (see CMakeLists.txt)
+#include "packet_kernel.h"
+
+PacketKernel packetKernelAVX2()
+{
+#ifdef SIMD_AVX2
+    return intersectGroup<simd::vfloat8>;
+#else
+    return nullptr;
+#endif
+}
+
+WideKernel<8> wideKernelAVX2()
+{
+#ifdef SIMD_AVX2
+    return intersectWideRay<simd::vfloat8>;
+#else
+    return nullptr;
+#endif
+}
+
+WideKernel<8> wideOcclusionKernelAVX2()
+{
+#ifdef SIMD_AVX2
+    return intersectWideRay<simd::vfloat8, true>;
+#else
+    return nullptr;
+#endif
+}
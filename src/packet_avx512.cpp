@@ -0,0 +1,11 @@
+// packet kernels for AVX-512, this file alone is compiled with AVX-512 enabled (see CMakeLists.txt)
+#include "packet_kernel.h"
+
+PacketKernel packetKernelAVX512()
+{
+#ifdef SIMD_AVX512
+    return intersectGroup<simd::vfloat16>;
+#else
+    return nullptr;
+#endif
+}
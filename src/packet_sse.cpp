@@ -0,0 +1,29 @@
+// packet and wide BVH kernels for SSE, part of every x86-64 target
+#include "packet_kernel.h"
+
+PacketKernel packetKernelSSE()
+{
+#ifdef SIMD_SSE
+    return intersectGroup<simd::vfloat4>;
+#else
+    return nullptr;
+#endif
+}
+
+WideKernel<4> wideKernelSSE()
+{
+#ifdef SIMD_SSE
+    return intersectWideRay<simd::vfloat4>;
+#else
+    return nullptr;
+#endif
+}
+
+WideKernel<4> wideOcclusionKernelSSE()
+{
+#ifdef SIMD_SSE
+    return intersectWideRay<simd::vfloat4, true>;
+#else
+    return nullptr;
+#endif
+}
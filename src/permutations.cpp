@@ -0,0 +1,61 @@
+#include "permutations.h"
+
+#include <algorithm>
+
+RaytracerFeatures RaytracerFeatures::fromScene(const Scene &scene, size_t triangleCount, uint32_t maxBounce)
+{
+    RaytracerFeatures features;
+    features.spheres = !scene.spheres.empty();
+    features.triangles = triangleCount > 0;
+    features.maxBounce = maxBounce;
+
+    // only materials that are actually referenced matter
+    features.diffuseOnly = true;
+    for (const GPUSphere &sphere : scene.spheres)
+        if (sphere.smoothness != 0.0f)
+            features.diffuseOnly = false;
+    for (const Mesh &mesh : scene.meshes)
+        if (!mesh.indices.empty() && scene.materials[mesh.materialIdx].smoothness != 0.0f)
+            features.diffuseOnly = false;
+
+    return features;
+}
+
+std::vector<std::string> RaytracerFeatures::defines() const
+{
+    std::vector<std::string> defines;
+    if (!spheres)
+        defines.push_back("NO_SPHERES");
+    if (!triangles)
+        defines.push_back("NO_TRIANGLES");
+    if (diffuseOnly)
+        defines.push_back("DIFFUSE_ONLY");
+    if (maxBounce > 0)
+        defines.push_back("MAX_BOUNCE " + std::to_string(maxBounce));
+    return defines;
+}
+
+ShaderPermutations::ShaderPermutations(const char *computePath) : path(computePath) {}
+
+ShaderPermutations::~ShaderPermutations()
+{
+    for (auto &[key, shader] : variants)
+        glDeleteProgram(shader.ID);
+}
+
+const Shader &ShaderPermutations::get(const std::vector<std::string> &defines)
+{
+    std::vector<std::string> sorted = defines;
+    std::sort(sorted.begin(), sorted.end());
+
+    std::string key;
+    for (const std::string &define : sorted)
+        key += define + ";";
+
+    auto it = variants.find(key);
+    if (it != variants.end())
+        return it->second;
+
+    std::cerr << "compiling " << path << " [" << key << "]\n";
+    return variants.try_emplace(key, path.c_str(), sorted).first->second;
+}
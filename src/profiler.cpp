@@ -0,0 +1,166 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+GPUProfiler::GPUProfiler()
+{
+    for (FrameQueries &frame : frames)
+    {
+        glGenQueries(PASS_COUNT, frame.queries);
+        std::fill(std::begin(frame.used), std::end(frame.used), false);
+        frame.pending = false;
+    }
+}
+
+GPUProfiler::~GPUProfiler()
+{
+    for (FrameQueries &frame : frames)
+        glDeleteQueries(PASS_COUNT, frame.queries);
+}
+
+void GPUProfiler::begin(Pass pass)
+{
+    FrameQueries &frame = frames[current];
+    if (frame.pending) // wrapped around before the results came in, only waits on very deep pipelines
+        collect(frame);
+
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[pass]);
+    frame.used[pass] = true;
+    open = pass;
+}
+
+void GPUProfiler::end(Pass pass)
+{
+    // a mismatch is the caller's bug, the open query is still ended so the next begin works
+    if (pass != open)
+        std::cerr << "GPUProfiler: end(" << PASS_NAMES[pass] << ") doesn't match begin("
+                  << (open != PASS_COUNT ? PASS_NAMES[open] : "none") << ")" << std::endl;
+    if (open == PASS_COUNT)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    open = PASS_COUNT;
+}
+
+void GPUProfiler::endFrame(float cpuMs, uint32_t samples, uint64_t rays)
+{
+    FrameQueries &frame = frames[current];
+    if (frame.pending)
+        collect(frame);
+
+    frame.timing = FrameTiming{frameCount++, cpuMs, {}, {}, samples, rays};
+    frame.pending = true;
+    current = (current + 1) % FRAMES_IN_FLIGHT;
+
+    // read whatever finished, oldest first so the history stays in order
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        FrameQueries &oldest = frames[(current + i) % FRAMES_IN_FLIGHT];
+        if (!oldest.pending)
+            continue;
+        if (!ready(oldest))
+            break;
+        collect(oldest);
+    }
+}
+
+bool GPUProfiler::ready(const FrameQueries &frame) const
+{
+    for (int pass = 0; pass < PASS_COUNT; pass++)
+    {
+        if (!frame.used[pass])
+            continue;
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(frame.queries[pass], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    return true;
+}
+
+void GPUProfiler::collect(FrameQueries &frame)
+{
+    for (int pass = 0; pass < PASS_COUNT; pass++)
+    {
+        GLuint64 ns = 0;
+        if (frame.used[pass])
+            glGetQueryObjectui64v(frame.queries[pass], GL_QUERY_RESULT, &ns);
+        frame.timing.passMs[pass] = ns / 1e6f;
+        frame.timing.ran[pass] = frame.used[pass];
+        frame.used[pass] = false;
+    }
+    frame.pending = false;
+
+    history.push_back(frame.timing);
+    if (history.size() > HISTORY)
+        history.pop_front();
+    finished.push_back(frame.timing);
+}
+
+std::vector<GPUProfiler::FrameTiming> GPUProfiler::takeFinished()
+{
+    std::vector<FrameTiming> out;
+    out.swap(finished);
+    return out;
+}
+
+float GPUProfiler::percentile(Pass pass, float p) const
+{
+    // frames that skipped the pass would count as 0 ms
+    std::vector<float> values;
+    values.reserve(history.size());
+    for (const FrameTiming &timing : history)
+        if (timing.ran[pass])
+            values.push_back(timing.passMs[pass]);
+    if (values.empty())
+        return 0.0f;
+
+    size_t n = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+double GPUProfiler::megaRaysPerSecond() const
+{
+    double rays = 0.0;
+    double ms = 0.0;
+    for (const FrameTiming &timing : history)
+    {
+        rays += timing.rays;
+        ms += timing.passMs[TRACE];
+    }
+    return ms > 0.0 ? rays / (ms * 1e3) : 0.0;
+}
+
+bool GPUProfiler::exportCSV(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: Could not write profile to " << path << std::endl;
+        return false;
+    }
+
+    file << "frame,cpu_ms";
+    for (const char *name : PASS_NAMES)
+        file << "," << name << "_ms";
+    file << ",spp,mrays_per_s\n";
+
+    for (const FrameTiming &timing : history)
+    {
+        file << timing.frame << "," << timing.cpuMs;
+        for (int pass = 0; pass < PASS_COUNT; pass++) // empty for passes that didn't run
+        {
+            file << ",";
+            if (timing.ran[pass])
+                file << timing.passMs[pass];
+        }
+        double mrays = timing.passMs[TRACE] > 0.0f ? timing.rays / (timing.passMs[TRACE] * 1e3) : 0.0;
+        file << "," << timing.samples << "," << mrays << "\n";
+    }
+
+    std::cout << "profile: wrote " << history.size() << " frames to " << path << "\n";
+    return true;
+}
@@ -0,0 +1,230 @@
+#include "rayquery.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace
+{
+    // 3 bits spread to every third bit
+    uint32_t spreadBits(uint32_t x)
+    {
+        return (x & 1) | (x & 2) << 2 | (x & 4) << 4;
+    }
+
+    uint32_t quantize(float x, uint32_t levels)
+    {
+        return std::min(static_cast<uint32_t>(std::clamp(x, 0.0f, 1.0f) * float(levels)), levels - 1);
+    }
+}
+
+RayQuery::RayQuery(const std::vector<glm::vec3> &vertices, const std::vector<uint32_t> &indices, const RayQueryOptions &options)
+    : options(options)
+{
+    std::vector<GPUTriangle> input;
+    input.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        GPUTriangle tri{};
+        tri.a = vertices[indices[i]];
+        tri.b = vertices[indices[i + 1]];
+        tri.c = vertices[indices[i + 2]];
+        input.push_back(tri);
+    }
+    build(std::move(input));
+}
+
+RayQuery::RayQuery(const std::vector<GPUTriangle> &triangles, const RayQueryOptions &options)
+    : options(options)
+{
+    build(triangles);
+}
+
+void RayQuery::build(std::vector<GPUTriangle> input)
+{
+    auto start = std::chrono::steady_clock::now();
+    primitives = input.size();
+
+    // the BVH reorders triangles, the pads remember where they came from
+    size_t count = input.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        input[i].pad0 = static_cast<uint32_t>(i);
+        input[i].pad1 = 0;
+    }
+
+    // the kernels cull back faces, a reversed copy turns each triangle's back into a front
+    if (options.twoSided)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            GPUTriangle reversed = input[i];
+            std::swap(reversed.b, reversed.c);
+            reversed.pad1 = 1;
+            input.push_back(reversed);
+        }
+    }
+
+    if (input.empty())
+    {
+        buildMs = msSince(start);
+        return;
+    }
+
+    BVH bvh(input, options.builder);
+    triangles = std::move(bvh.triangles);
+    nodes = std::move(bvh.nodes);
+
+    boundsMin = glm::vec3(nodes[0].min);
+    boundsSize = glm::max(glm::vec3(nodes[0].max) - boundsMin, glm::vec3(1E-6f));
+
+    wideWidth = wideBVHWidth(options.isa);
+    if (wideWidth == 4)
+        wide4 = WideBVH<4>(nodes, triangles);
+    else if (wideWidth == 8)
+        wide8 = WideBVH<8>(nodes, triangles);
+
+    buildMs = msSince(start);
+}
+
+void RayQuery::sortBatch(const QueryRay *rays, size_t count, uint32_t *order) const
+{
+    // counting sort by the origin's cell on an 8x8x8 grid over the scene in Morton order, then by
+    // direction octant, so rays leaving one point stay together
+    constexpr uint32_t KEYS = 512 * 8;
+    std::vector<uint32_t> start(KEYS + 1, 0);
+    std::vector<uint16_t> keys(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const QueryRay &ray = rays[i];
+        glm::vec3 p = (ray.origin - boundsMin) / boundsSize;
+
+        uint32_t cell = spreadBits(quantize(p.x, 8)) | spreadBits(quantize(p.y, 8)) << 1 | spreadBits(quantize(p.z, 8)) << 2;
+        uint32_t octant = (ray.direction.x < 0.0f) | (ray.direction.y < 0.0f) << 1 | (ray.direction.z < 0.0f) << 2;
+        keys[i] = static_cast<uint16_t>(cell << 3 | octant);
+        start[keys[i] + 1]++;
+    }
+    for (uint32_t key = 0; key < KEYS; key++)
+        start[key + 1] += start[key];
+    for (uint32_t i = 0; i < count; i++)
+        order[start[keys[i]]++] = i;
+}
+
+void RayQuery::traceRay(const QueryRay &ray, bool anyHit, float &tMax, uint32_t &triangle) const
+{
+    float origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+    float direction[3] = {ray.direction.x, ray.direction.y, ray.direction.z};
+    tMax = ray.tMax;
+
+    if (wideWidth == 8)
+    {
+        if (anyHit)
+            intersectWideAny(wide8.view(), origin, direction, tMax, triangle);
+        else
+            intersectWide(wide8.view(), origin, direction, tMax, triangle);
+        return;
+    }
+    if (wideWidth == 4)
+    {
+        if (anyHit)
+            intersectWideAny(wide4.view(), origin, direction, tMax, triangle);
+        else
+            intersectWide(wide4.view(), origin, direction, tMax, triangle);
+        return;
+    }
+
+    // the binary BVH has no any hit traversal, its closest hit answers occlusion too
+    RayPacket packet;
+    packet.ox[0] = origin[0];
+    packet.oy[0] = origin[1];
+    packet.oz[0] = origin[2];
+    packet.dx[0] = direction[0];
+    packet.dy[0] = direction[1];
+    packet.dz[0] = direction[2];
+    packet.tMax[0] = tMax;
+    packet.count = 1;
+    intersectPacket(ISA_SCALAR, BVHView{nodes.empty() ? nullptr : nodes.data(), triangles.data()}, packet);
+    tMax = packet.tMax[0];
+    triangle = packet.triangle[0];
+}
+
+template <class Visit>
+void RayQuery::traceStream(const QueryRay *rays, size_t count, bool anyHit, const Visit &visit) const
+{
+    float tMax;
+    uint32_t triangle;
+    if (options.reorderBatch == 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            traceRay(rays[i], anyHit, tMax, triangle);
+            visit(i, tMax, triangle);
+        }
+        return;
+    }
+
+    std::vector<uint32_t> order(std::min<size_t>(count, options.reorderBatch));
+    for (size_t first = 0; first < count; first += options.reorderBatch)
+    {
+        size_t batch = std::min<size_t>(options.reorderBatch, count - first);
+        sortBatch(rays + first, batch, order.data());
+        for (size_t i = 0; i < batch; i++)
+        {
+            size_t index = first + order[i];
+            traceRay(rays[index], anyHit, tMax, triangle);
+            visit(index, tMax, triangle);
+        }
+    }
+}
+
+void RayQuery::finishHit(const QueryRay &ray, uint32_t triangle, float distance, QueryHit &hit) const
+{
+    hit.distance = distance;
+    if (triangle == RayPacket::NO_HIT)
+    {
+        hit.primitive = MISS;
+        hit.u = hit.v = 0.0f;
+        return;
+    }
+
+    // the kernels only keep the distance, the barycentrics are found again for the one hit triangle
+    const GPUTriangle &tri = triangles[triangle];
+    glm::vec3 edge1 = tri.b - tri.a;
+    glm::vec3 edge2 = tri.c - tri.a;
+    glm::vec3 ao = ray.origin - tri.a;
+    glm::vec3 dao = glm::cross(ao, ray.direction);
+    float invdet = -1.0f / glm::dot(ray.direction, glm::cross(edge1, edge2));
+    float u = glm::dot(edge2, dao) * invdet;
+    float v = -glm::dot(edge1, dao) * invdet;
+
+    hit.primitive = tri.pad0;
+    hit.u = tri.pad1 ? v : u; // b and c are swapped in reversed copies
+    hit.v = tri.pad1 ? u : v;
+}
+
+void RayQuery::closestHit(const QueryRay *rays, QueryHit *hits, size_t count) const
+{
+    traceStream(rays, count, false, [&](size_t index, float tMax, uint32_t triangle)
+                { finishHit(rays[index], triangle, tMax, hits[index]); });
+}
+
+std::vector<QueryHit> RayQuery::closestHit(const std::vector<QueryRay> &rays) const
+{
+    std::vector<QueryHit> hits(rays.size());
+    closestHit(rays.data(), hits.data(), rays.size());
+    return hits;
+}
+
+void RayQuery::occluded(const QueryRay *rays, uint8_t *results, size_t count) const
+{
+    traceStream(rays, count, true, [&](size_t index, float, uint32_t triangle)
+                { results[index] = triangle != RayPacket::NO_HIT; });
+}
+
+std::vector<uint8_t> RayQuery::occluded(const std::vector<QueryRay> &rays) const
+{
+    std::vector<uint8_t> results(rays.size());
+    occluded(rays.data(), results.data(), rays.size());
+    return results;
+}
@@ -0,0 +1,289 @@
+#include "renderer.h"
+#include "bvh.h"
+#include "layouts.h"
+#include "texture.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace
+{
+    // replaces the buffer, zero sized bindings are invalid so empty arrays get one element of padding
+    void uploadSSBO(unsigned int &ssbo, GLuint binding, size_t size, const void *data, GLenum usage)
+    {
+        if (ssbo != 0)
+            glDeleteBuffers(1, &ssbo);
+
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(size, 16), nullptr, usage);
+        if (size > 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
+    }
+
+    GPUCameraData cameraData(const Camera &camera, const Camera &prevCamera)
+    {
+        return GPUCameraData{
+            glm::vec4(camera.cameraPos, 0), glm::vec4(camera.cameraFront, 0), glm::vec4(camera.cameraUp, 0),
+            glm::vec4(prevCamera.cameraPos, 0), glm::vec4(prevCamera.cameraFront, 0), glm::vec4(prevCamera.cameraUp, 0)};
+    }
+}
+
+Renderer::Renderer(unsigned int width, unsigned int height)
+    : width(width), height(height), denoiser(width, height), traversalStats(width, height),
+      permutations("assets/raytracer.comp") // variant is picked once the scene is known
+{
+    accumTex = createImageTexture(width, height, GL_RGBA32F, GL_RGBA);
+    depthTex = createImageTexture(width, height, GL_R32F, GL_RED);
+    normalTex = createImageTexture(width, height, GL_RGBA32F, GL_RGBA);
+    albedoTex = createImageTexture(width, height, GL_RGBA32F, GL_RGBA);
+    historyTex = createImageTexture(width, height, GL_RGBA32F, GL_RGBA);
+    historyDepthTex = createImageTexture(width, height, GL_R32F, GL_RED);
+
+    std::vector<uint32_t> sobolMatrices = buildSobolMatrices();
+    uploadSSBO(sobolSSBO, Binding::SOBOL_MATRICES, sobolMatrices.size() * sizeof(uint32_t), sobolMatrices.data(), GL_STATIC_DRAW);
+
+    // numRaysPerPixel follows the frame budget
+    uploadSSBO(dataSSBO, Binding::SCENE_DATA, sizeof(GPUSceneData), &sceneData, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &cameraUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+    GPUCameraData data = cameraData(prevCamera, prevCamera);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GPUCameraData), &data, GL_DYNAMIC_DRAW);
+}
+
+Renderer::~Renderer()
+{
+    unsigned int textures[] = {accumTex, depthTex, normalTex, albedoTex, historyTex, historyDepthTex};
+    glDeleteTextures(6, textures);
+
+    unsigned int buffers[] = {sphereSSBO, matSSBO, triSSBO, bvhSSBO, dataSSBO, sobolSSBO, cameraUBO};
+    glDeleteBuffers(7, buffers);
+}
+
+bool Renderer::loadScene(const Scene &scene)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GPUTriangle> triangles;
+    std::vector<GPUMesh> gpuMeshes;
+    convertToGPUMeshes(scene, triangles, gpuMeshes);
+    convertMs = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    BVH bvh(triangles, bvhBuilder); // bvh's the triangles
+    bvhMs = msSince(start);
+    std::cerr << "bvh built with: " << bvh.nodes.size() << " nodes\n";
+
+    start = std::chrono::steady_clock::now();
+    sphereCount = scene.spheres.size();
+    triangleCount = triangles.size();
+    nodeCount = bvh.nodes.size();
+
+    uploadSSBO(sphereSSBO, Binding::SPHERES, scene.spheres.size() * sizeof(GPUSphere), scene.spheres.data(), GL_STATIC_DRAW);
+    uploadSSBO(matSSBO, Binding::MATERIALS, scene.materials.size() * sizeof(GPUMaterial), scene.materials.data(), GL_STATIC_DRAW);
+
+    // reordered by the build, the leaves index into this copy
+    uploadSSBO(triSSBO, Binding::TRIANGLES, bvh.triangles.size() * sizeof(GPUTriangle), bvh.triangles.data(), GL_STATIC_DRAW);
+    uploadSSBO(bvhSSBO, Binding::BVH_NODES, bvh.nodes.size() * sizeof(BVH::GPUNode), bvh.nodes.data(), GL_STATIC_DRAW);
+    glFinish();
+    uploadMs = msSince(start);
+
+    // specialize the raytracer on what the scene actually contains
+    features = RaytracerFeatures::fromScene(scene, triangleCount, sceneData.maxBounce);
+
+    Autotuner autotuner(features, triangleCount);
+    workGroup = WorkGroupSize();
+    if (!autotuner.load(workGroup))
+        std::cerr << "no tuned work group size for this device, using " << workGroup.x << "x" << workGroup.y << " (run with --autotune)\n";
+
+    resetAccumulation();
+    return selectVariant();
+}
+
+bool Renderer::autotune()
+{
+    bindResources();
+
+    Autotuner autotuner(features, triangleCount);
+    double ms;
+    workGroup = autotuner.run(permutations, width, height, [this](const Shader &shader)
+                              {
+                                  setUniforms(shader);
+                                  shader.setUint("frameIndex", 0);
+                                  shader.setUint("sampleIndex", 0);
+                                  shader.setUint("reproject", 0);
+                                  shader.setUint("primaryCacheValid", 0);
+                              },
+                              ms);
+    if (ms >= 0.0)
+        autotuner.save(workGroup, ms);
+
+    resetAccumulation();
+    return selectVariant();
+}
+
+std::vector<std::string> Renderer::variantDefines() const
+{
+    std::vector<std::string> defines = features.defines();
+    for (const std::string &define : workGroup.defines())
+        defines.push_back(define);
+    return defines;
+}
+
+bool Renderer::selectVariant()
+{
+    raytracer = &permutations.get(variantDefines());
+    statsRaytracer = nullptr;
+
+    if (!verifyGPULayouts(*raytracer))
+    {
+        std::cerr << "ERROR: GPU struct layouts do not match raytracer.comp" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Renderer::setSamplesPerPixel(uint32_t samples)
+{
+    if (samples == sceneData.numRaysPerPixel)
+        return;
+
+    // the accumulation weighs by sample count so spp can change at any time
+    sceneData.numRaysPerPixel = samples;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(GPUSceneData, numRaysPerPixel), sizeof(uint32_t), &sceneData.numRaysPerPixel);
+}
+
+void Renderer::resetAccumulation(uint32_t firstSample)
+{
+    frameIndex = 0;
+    sampleIndex = firstSample;
+}
+
+void Renderer::invalidatePrimaryCache()
+{
+    primaryCacheStale = true;
+}
+
+void Renderer::bindResources() const
+{
+    glBindImageTexture(0, accumTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, depthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(2, historyTex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(3, historyDepthTex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(4, normalTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(5, albedoTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::SPHERES, sphereSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::MATERIALS, matSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::TRIANGLES, triSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::BVH_NODES, bvhSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::SCENE_DATA, dataSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::SOBOL_MATRICES, sobolSSBO);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Binding::CAMERA_DATA, cameraUBO);
+}
+
+void Renderer::setUniforms(const Shader &shader) const
+{
+    shader.setFloat("historyLimit", historyLimit);
+    shader.setUint("sphereCount", sphereCount);
+    shader.setUint("samplerType", static_cast<uint32_t>(samplerType));
+    shader.setUint("seed", seed);
+    shader.setUint("firstRow", traceFirstRow);
+    shader.setUint("lastRow", traceLastRow != 0 ? std::min(traceLastRow, height) : height);
+}
+
+bool Renderer::trace(const Camera &camera, bool cameraMoved, uint32_t dispatches)
+{
+    if (!raytracer)
+        return false;
+
+    // reprojection
+    bool reproject = false;
+    if (cameraMoved)
+    {
+        if (reprojection && frameIndex != 0)
+        {
+            glCopyImageSubData(accumTex, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               historyTex, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               width, height, 1);
+            glCopyImageSubData(depthTex, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               historyDepthTex, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               width, height, 1);
+            reproject = true;
+        }
+        else
+            resetAccumulation();
+    }
+
+    const Shader *active = raytracer;
+    if (traversalStats.enabled)
+    {
+        if (!statsRaytracer)
+        {
+            std::vector<std::string> defines = variantDefines();
+            defines.push_back("TRAVERSAL_STATS");
+            statsRaytracer = &permutations.get(defines);
+            if (!verifyGPULayouts(*statsRaytracer))
+            {
+                std::cerr << "ERROR: GPU struct layouts do not match raytracer.comp" << std::endl;
+                return false;
+            }
+        }
+        traversalStats.bind();
+        active = statsRaytracer;
+    }
+
+    bindResources();
+
+    GPUCameraData data = cameraData(camera, prevCamera);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GPUCameraData), &data);
+
+    glUseProgram(active->ID);
+    active->setFloat("fov", camera.fov);
+    setUniforms(*active);
+
+    for (uint32_t i = 0; i < dispatches; i++)
+    {
+        bool reprojectDispatch = reproject && i == 0; // later dispatches accumulate onto the reprojected result
+
+        active->setUint("frameIndex", frameIndex);
+        active->setUint("sampleIndex", sampleIndex);
+        active->setUint("reproject", reprojectDispatch);
+
+        // the g-buffer still holds this camera's primary hits unless it moved or was reset
+        active->setUint("primaryCacheValid", frameIndex != 0 && !reprojectDispatch && !primaryCacheStale);
+        primaryCacheStale = false;
+
+        uint32_t lastRow = traceLastRow != 0 ? std::min(traceLastRow, height) : height;
+        active->dispatch(width, lastRow - std::min(traceFirstRow, lastRow));
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // needed for shared frames
+
+        frameIndex++; // * Comment out to disable accumulation
+        sampleIndex += sceneData.numRaysPerPixel;
+    }
+    prevCamera = camera;
+
+    if (traversalStats.enabled)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT); // pass.frag reads the counters
+        if (statsFrame++ % TraversalStats::REDUCE_INTERVAL == 0)
+            traversalStats.reduce();
+    }
+    else
+        statsFrame = 0;
+
+    return true;
+}
+
+unsigned int Renderer::denoise()
+{
+    if (!denoiser.enabled)
+        return accumTex;
+    return denoiser.apply(accumTex, depthTex, normalTex, albedoTex);
+}
@@ -0,0 +1,51 @@
+#include "sampler.h"
+
+std::vector<uint32_t> buildSobolMatrices(uint32_t dimensions)
+{
+    // primitive polynomial degree s, coefficients a and initial direction numbers m (new-joe-kuo-6.21201)
+    struct Polynomial
+    {
+        uint32_t s, a;
+        uint32_t m[8];
+    };
+    static const Polynomial polynomials[] = {
+        {1, 0, {1}},
+        {2, 1, {1, 3}},
+        {3, 1, {1, 3, 1}},
+        {3, 2, {1, 1, 1}},
+        {4, 1, {1, 1, 3, 3}},
+        {4, 4, {1, 3, 5, 13}},
+        {5, 2, {1, 1, 5, 5, 17}},
+    };
+    constexpr uint32_t maxDimensions = 1 + sizeof(polynomials) / sizeof(polynomials[0]);
+    if (dimensions > maxDimensions)
+        dimensions = maxDimensions;
+
+    std::vector<uint32_t> matrices(dimensions * SOBOL_BITS);
+
+    // dimension 0 is the van der Corput sequence
+    for (uint32_t bit = 0; bit < SOBOL_BITS; bit++)
+        matrices[bit] = 1u << (31 - bit);
+
+    for (uint32_t dim = 1; dim < dimensions; dim++)
+    {
+        const Polynomial &p = polynomials[dim - 1];
+        uint32_t *v = &matrices[dim * SOBOL_BITS];
+
+        for (uint32_t bit = 0; bit < SOBOL_BITS; bit++)
+        {
+            if (bit < p.s)
+            {
+                v[bit] = p.m[bit] << (31 - bit);
+                continue;
+            }
+
+            v[bit] = v[bit - p.s] ^ (v[bit - p.s] >> p.s);
+            for (uint32_t k = 1; k < p.s; k++)
+                if ((p.a >> (p.s - 1 - k)) & 1u)
+                    v[bit] ^= v[bit - k];
+        }
+    }
+
+    return matrices;
+}
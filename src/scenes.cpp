@@ -0,0 +1,139 @@
+#include "scenes.h"
+
+#include <cmath>
+
+namespace
+{
+    constexpr double PI = 3.14159265358979323846; // M_PI isn't standard
+
+    // -- Shared Pieces --
+
+    void addFloor(Scene &scene)
+    {
+        scene.meshes.push_back(loadRect({{{0, 0, -12.5f}, {0, 0, 0}, {40, .5f, 40}}, {{1, 1, 1}, 0.f, {0, 0, 0, 0}}}, scene));
+    }
+
+    void addLight(Scene &scene, glm::vec3 position)
+    {
+        scene.spheres.push_back({position, 1.0f, {1.f, 1.f, 1.f}, 0.f, {1.f, 1.f, 1.f, 1.0f}});
+    }
+
+    glm::vec3 colorWheel(float angle)
+    {
+        return glm::vec3(0.5f + 0.5f * sin(angle),
+                         0.5f + 0.5f * sin(angle + 2.0f * PI / 3.0f),
+                         0.5f + 0.5f * sin(angle + 4.0f * PI / 3.0f));
+    }
+
+    // -- Scenes --
+
+    void buildDefault(Scene &scene)
+    {
+        scene.meshes.push_back(loadMesh("assets/models/dragon8k.obj", GPUMaterial{{1.f, 1.f, 1.f}, 0.1f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 2.f, 0.f}, {}, glm::vec3(4)}, scene.materials));
+        addFloor(scene);
+
+        { // creates a circle of spheres in a color wheel
+            int sides = 6;
+            float radius = 3.f;
+            float origin[2] = {5.5, 0.0};
+            for (int i = 0; i < sides; i++)
+            {
+                float angle = 2.0f * PI * i / sides + PI / 2.0f;
+                glm::vec3 color = colorWheel(angle);
+
+                // x (up), y, z (right)
+                scene.spheres.push_back({{radius * sin(angle) + origin[0], 1.5, radius * cos(angle) + origin[1]}, 1.0f, {0.f, 0.f, 0.f}, 0.f, {color, 1.f}});
+            }
+        }
+
+        addLight(scene, {5.5, 8, 0.f});
+    }
+
+    void buildCube(Scene &scene)
+    {
+        scene.meshes.push_back(loadMesh("assets/models/cube.obj", GPUMaterial{{0.9f, 0.4f, 0.3f}, 0.f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 1.5f, 0.f}, {0.f, 0.6f, 0.f}, glm::vec3(1.5f)}, scene.materials));
+        addFloor(scene);
+        addLight(scene, {5.5, 8, 0.f});
+    }
+
+    void buildTeapot(Scene &scene)
+    {
+        scene.meshes.push_back(loadMesh("assets/models/teapot.obj", GPUMaterial{{1.f, 1.f, 1.f}, 0.1f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 0.5f, 0.f}, {}, glm::vec3(0.04f)}, scene.materials)); // model is ~150 units wide
+        addFloor(scene);
+        addLight(scene, {5.5, 8, 0.f});
+    }
+
+    void buildDragon(Scene &scene)
+    {
+        scene.meshes.push_back(loadMesh("assets/models/dragon8k.obj", GPUMaterial{{1.f, 1.f, 1.f}, 0.1f, {0.f, 0.f, 0.f, 0.f}}, Transform{{5.5f, 2.f, 0.f}, {}, glm::vec3(4)}, scene.materials));
+        addFloor(scene);
+        addLight(scene, {5.5, 8, 0.f});
+    }
+
+    void buildSphereField(Scene &scene)
+    {
+        // 16x16 grid, every 5th sphere glows
+        const int side = 16;
+        for (int x = 0; x < side; x++)
+        {
+            for (int z = 0; z < side; z++)
+            {
+                int i = x * side + z;
+                glm::vec3 color = colorWheel(0.37f * i);
+                float emission = i % 5 == 0 ? 1.f : 0.f;
+                float smoothness = (i % 3) / 2.0f;
+                scene.spheres.push_back({{5.5f + (x - side / 2) * 1.2f, 0.75f, (z - side / 2) * 1.2f}, 0.5f, color, smoothness, {color, emission}});
+            }
+        }
+        addFloor(scene);
+    }
+
+    void buildInstanced(Scene &scene)
+    {
+        // one teapot load, the meshes share its vertex data and only differ by transform
+        Mesh teapot = loadMesh("assets/models/teapot.obj", GPUMaterial{{0.8f, 0.8f, 0.8f}, 0.3f, {0.f, 0.f, 0.f, 0.f}}, Transform{}, scene.materials);
+        for (int x = -2; x <= 2; x++)
+        {
+            for (int z = -2; z <= 2; z++)
+            {
+                Mesh instance = teapot;
+                instance.transform = Transform{{5.5f + x * 3.f, 0.5f, z * 3.f}, {0.f, 0.4f * (x + z), 0.f}, glm::vec3(0.015f)};
+                scene.meshes.push_back(instance);
+            }
+        }
+        addFloor(scene);
+        addLight(scene, {5.5, 10, 0.f});
+    }
+}
+
+const std::vector<SceneDesc> &sceneRegistry()
+{
+    static const std::vector<SceneDesc> scenes = {
+        {"default", buildDefault, {5.5f, 1.5f, 0.f}, 7.5f, 5.5f},
+        {"cube", buildCube, {5.5f, 1.5f, 0.f}, 7.5f, 5.5f},
+        {"teapot", buildTeapot, {5.5f, 1.5f, 0.f}, 7.5f, 5.5f},
+        {"dragon8k", buildDragon, {5.5f, 1.5f, 0.f}, 7.5f, 5.5f},
+        {"spheres", buildSphereField, {5.5f, 0.5f, 0.f}, 12.f, 7.f},
+        {"instanced", buildInstanced, {5.5f, 1.f, 0.f}, 11.f, 8.f},
+    };
+    return scenes;
+}
+
+const SceneDesc *findScene(const std::string &name)
+{
+    for (const SceneDesc &desc : sceneRegistry())
+        if (name == desc.name)
+            return &desc;
+    return nullptr;
+}
+
+Camera orbitCamera(const SceneDesc &desc, float t)
+{
+    float angle = 2.0f * PI * t;
+    glm::vec3 position = desc.target + glm::vec3(-cos(angle) * desc.orbitRadius, desc.orbitHeight, -sin(angle) * desc.orbitRadius);
+
+    glm::vec3 dir = glm::normalize(desc.target - position);
+    float yaw = glm::degrees(atan2(dir.z, dir.x));
+    float pitch = glm::degrees(asin(dir.y));
+    return Camera(90.0f, 6.0f, yaw, pitch, position);
+}
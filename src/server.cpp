@@ -0,0 +1,753 @@
+#include "server.h"
+
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cputracer.h"
+#include "headless.h"
+#include "image.h"
+#include "jobqueue.h"
+#include "offscreen.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "texture.h"
+#include "timing.h"
+
+namespace
+{
+    static constexpr unsigned int MAX_SIZE = 4096;       // per side of a requested image, without --max-size
+    static constexpr size_t MAX_LINE = 4096;             // requests are one short line
+    static constexpr double MAX_DEADLINE_MS = 86400e3;   // a day, later deadlines are as good as none
+
+    std::atomic<bool> stopRequested{false};
+
+    void onSignal(int)
+    {
+        stopRequested = true;
+    }
+
+    // -- Socket IO --
+
+    // Reads up to the next newline into line, keeping whatever came after it in pending. False once
+    // the peer is gone or sends a line that is far too long.
+    bool readLine(int fd, std::string &pending, std::string &line)
+    {
+        while (true)
+        {
+            size_t end = pending.find('\n');
+            if (end != std::string::npos)
+            {
+                line = pending.substr(0, end);
+                pending.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                return true;
+            }
+            if (pending.size() > MAX_LINE)
+                return false;
+
+            char buffer[1024];
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                return false;
+            pending.append(buffer, static_cast<size_t>(received));
+        }
+    }
+
+    bool readAll(int fd, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0)
+        {
+            ssize_t received = recv(fd, bytes, size, 0);
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    bool writeAll(int fd, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t sent = write(fd, bytes, size);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool writeLine(int fd, const std::string &line)
+    {
+        std::string terminated = line + "\n";
+        return writeAll(fd, terminated.data(), terminated.size());
+    }
+
+    bool socketAddress(const std::string &path, sockaddr_un &address)
+    {
+        address = sockaddr_un{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "socket path must be 1 to " << sizeof(address.sun_path) - 1 << " characters" << std::endl;
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    int connectTo(const std::string &path)
+    {
+        sockaddr_un address;
+        if (!socketAddress(path, address))
+            return -1;
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // value of key=value in a header line, empty if it isn't there
+    std::string headerValue(const std::string &header, const std::string &key)
+    {
+        std::istringstream tokens(header);
+        std::string token;
+        while (tokens >> token)
+            if (token.compare(0, key.size() + 1, key + "=") == 0)
+                return token.substr(key.size() + 1);
+        return "";
+    }
+
+    // -- Requests --
+
+    // the key=value pairs after "render", false with error set on anything unknown or too large
+    bool parseJob(std::istringstream &tokens, unsigned int maxSize, RenderJob &job, std::string &error)
+    {
+        std::string token;
+        while (tokens >> token)
+        {
+            size_t equals = token.find('=');
+            if (equals == std::string::npos)
+            {
+                error = "expected key=value, got " + token;
+                return false;
+            }
+            std::string key = token.substr(0, equals);
+            std::string value = token.substr(equals + 1);
+
+            if (key == "scene")
+                job.scene = value;
+            else if (key == "width" || key == "height")
+            {
+                // the accumulation and g-buffer are several float RGBA images of that size
+                long size = std::max(1L, std::atol(value.c_str()));
+                if (size > long(maxSize))
+                {
+                    error = key + " over the server's maximum of " + std::to_string(maxSize);
+                    return false;
+                }
+                if (key == "width")
+                    job.width = static_cast<unsigned int>(size);
+                else
+                    job.height = static_cast<unsigned int>(size);
+            }
+            else if (key == "spp")
+                job.spp = std::max(1, std::atoi(value.c_str()));
+            else if (key == "orbit")
+                job.orbit = std::strtof(value.c_str(), nullptr);
+            else if (key == "camera")
+            {
+                if (!parseCamera(value, job.position, job.yaw, job.pitch))
+                {
+                    error = "camera expects x,y,z,yaw,pitch";
+                    return false;
+                }
+                job.customCamera = true;
+            }
+            else if (key == "sampler")
+            {
+                if (value == "pcg")
+                    job.samplerType = SamplerType::PCG;
+                else if (value == "sobol")
+                    job.samplerType = SamplerType::SOBOL;
+                else
+                {
+                    error = "sampler expects pcg or sobol";
+                    return false;
+                }
+            }
+            else if (key == "denoise")
+                job.denoise = value != "0";
+            else if (key == "priority")
+                job.priority = std::atoi(value.c_str());
+            else if (key == "deadline")
+            {
+                // clamped to a day, larger values would overflow the time point and break the queue order
+                double ms = std::min(std::strtod(value.c_str(), nullptr), MAX_DEADLINE_MS);
+                if (ms > 0.0)
+                    job.deadline = job.submitted + std::chrono::microseconds(static_cast<int64_t>(ms * 1e3));
+            }
+            else
+            {
+                error = "unknown key " + key;
+                return false;
+            }
+        }
+
+        if (!findScene(job.scene))
+        {
+            error = "unknown scene " + job.scene;
+            return false;
+        }
+        return true;
+    }
+
+    struct ServerOptions
+    {
+        std::string socketPath;
+        bool cpu = false;                 // --backend cpu
+        unsigned int threads = 0;         // cpu backend, 0 = all hardware threads
+        size_t resident = 4;              // renderers kept loaded, by scene and resolution
+        unsigned int maxSize = MAX_SIZE;  // per side of a requested image
+        std::vector<std::string> preload; // scenes built before listening
+    };
+
+    class RenderServer
+    {
+    public:
+        explicit RenderServer(const ServerOptions &options) : options(options) {}
+
+        int run(); // until shutdown or a signal, renders on the calling thread
+
+    private:
+        // a loaded scene at one resolution, the renderers size their images on construction
+        struct Resident
+        {
+            std::string scene;
+            unsigned int width = 0, height = 0;
+            std::unique_ptr<Renderer> renderer; // gpu backend
+            std::unique_ptr<CPUTracer> tracer;  // cpu backend
+            uint64_t lastUsed = 0;
+        };
+
+        const ServerOptions &options;
+        OffscreenContext context; // outlives the renderers
+
+        // -- Render Thread --
+        std::map<std::string, Scene> scenes;
+        std::vector<std::unique_ptr<Resident>> residents;
+        uint64_t uses = 0;
+
+        JobQueue queue;
+        std::atomic<bool> stopping{false};
+        std::atomic<uint64_t> nextId{1};
+        std::atomic<uint64_t> done{0}, failed{0}, expired{0};
+        std::atomic<size_t> residentCount{0};
+
+        // -- Connections --
+        int listenFd = -1;
+        std::mutex clientsMutex;
+        std::condition_variable clientsDone;
+        std::vector<int> clients;
+
+        bool listen();
+        void acceptLoop();
+        void serveClient(int fd);
+        std::string status() const;
+
+        const Scene &scene(const std::string &name);
+        Resident *acquire(const RenderJob &job, std::string &error);
+        RenderResult render(const RenderJob &job);
+    };
+
+    int RenderServer::run()
+    {
+        if (!options.cpu && !context.create(640, 480))
+            return -1;
+
+        for (const std::string &name : options.preload)
+            scene(name);
+
+        if (!listen())
+            return -1;
+        std::cout << "listening on " << options.socketPath << " (" << (options.cpu ? "cpu" : "gpu") << ")" << std::endl;
+
+        std::thread acceptor(&RenderServer::acceptLoop, this);
+
+        // -- Render Loop --
+        while (!stopping && !stopRequested)
+        {
+            JobQueue::Entry entry;
+            if (!queue.pop(entry, std::chrono::milliseconds(200)))
+                continue;
+
+            const RenderJob &job = entry.job;
+            double waitMs = msSince(job.submitted);
+            if (std::chrono::steady_clock::now() > job.deadline)
+            {
+                expired++;
+                RenderResult result;
+                result.error = "deadline passed after " + std::to_string(static_cast<int>(waitMs)) + " ms in the queue";
+                result.waitMs = waitMs;
+                std::printf("job %llu: %s\n", (unsigned long long)job.id, result.error.c_str());
+                std::fflush(stdout);
+                entry.result.set_value(std::move(result));
+                continue;
+            }
+
+            RenderResult result = render(job);
+            result.waitMs = waitMs;
+            (result.ok ? done : failed)++;
+            std::printf("job %llu: %s %ux%u %u spp, priority %d, waited %.1f ms, %s in %.1f ms\n", (unsigned long long)job.id,
+                        job.scene.c_str(), job.width, job.height, job.spp, job.priority, result.waitMs,
+                        result.ok ? "rendered" : result.error.c_str(), result.renderMs);
+            std::fflush(stdout);
+            entry.result.set_value(std::move(result));
+        }
+
+        // -- Shutdown -- queued jobs fail, then connections are closed and waited for
+        stopping = true;
+        queue.close("server shutting down");
+        acceptor.join();
+        close(listenFd);
+        unlink(options.socketPath.c_str());
+
+        std::unique_lock<std::mutex> lock(clientsMutex);
+        for (int fd : clients)
+            shutdown(fd, SHUT_RDWR);
+        clientsDone.wait(lock, [this]
+                         { return clients.empty(); });
+
+        std::cout << "served " << done << " jobs, " << failed << " failed, " << expired << " expired" << std::endl;
+        return 0;
+    }
+
+    bool RenderServer::listen()
+    {
+        sockaddr_un address;
+        if (!socketAddress(options.socketPath, address))
+            return false;
+
+        // a socket file nobody answers on is left over from a server that didn't shut down
+        int existing = connectTo(options.socketPath);
+        if (existing >= 0)
+        {
+            close(existing);
+            std::cerr << "another server is listening on " << options.socketPath << std::endl;
+            return false;
+        }
+        unlink(options.socketPath.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, 16) != 0)
+        {
+            std::cerr << "can't listen on " << options.socketPath << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void RenderServer::acceptLoop()
+    {
+        while (!stopping && !stopRequested)
+        {
+            pollfd listening{listenFd, POLLIN, 0};
+            if (poll(&listening, 1, 200) <= 0)
+                continue;
+
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.push_back(fd);
+            std::thread(&RenderServer::serveClient, this, fd).detach(); // run waits for clients to drain
+        }
+    }
+
+    void RenderServer::serveClient(int fd)
+    {
+        std::string pending, line;
+        while (readLine(fd, pending, line))
+        {
+            std::istringstream tokens(line);
+            std::string command;
+            if (!(tokens >> command))
+                continue;
+
+            if (command == "status")
+            {
+                if (!writeLine(fd, status()))
+                    break;
+                continue;
+            }
+            if (command == "shutdown")
+            {
+                stopping = true;
+                writeLine(fd, "ok");
+                break;
+            }
+            if (command != "render")
+            {
+                if (!writeLine(fd, "error unknown command " + command))
+                    break;
+                continue;
+            }
+
+            RenderJob job;
+            job.id = nextId++;
+            job.submitted = std::chrono::steady_clock::now();
+            std::string error;
+            if (!parseJob(tokens, options.maxSize, job, error))
+            {
+                if (!writeLine(fd, "error id=" + std::to_string(job.id) + " " + error))
+                    break;
+                continue;
+            }
+
+            RenderResult result = queue.push(job).get();
+            if (!result.ok)
+            {
+                if (!writeLine(fd, "error id=" + std::to_string(job.id) + " " + result.error))
+                    break;
+                continue;
+            }
+
+            size_t bytes = result.pixels.size() * sizeof(float);
+            char header[256];
+            std::snprintf(header, sizeof(header), "ok id=%llu width=%u height=%u wait_ms=%.1f render_ms=%.1f bytes=%zu",
+                          (unsigned long long)job.id, job.width, job.height, result.waitMs, result.renderMs, bytes);
+            if (!writeLine(fd, header) || !writeAll(fd, result.pixels.data(), bytes))
+                break;
+        }
+
+        // out of clients before closing, run() shuts down every fd in there and the number may be reused
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        clients.erase(std::find(clients.begin(), clients.end(), fd));
+        close(fd);
+        clientsDone.notify_all();
+    }
+
+    std::string RenderServer::status() const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "ok backend=%s queued=%zu done=%llu failed=%llu expired=%llu resident=%zu",
+                      options.cpu ? "cpu" : "gpu", queue.size(), (unsigned long long)done.load(),
+                      (unsigned long long)failed.load(), (unsigned long long)expired.load(), residentCount.load());
+        return line;
+    }
+
+    const Scene &RenderServer::scene(const std::string &name)
+    {
+        auto it = scenes.find(name);
+        if (it != scenes.end())
+            return it->second;
+
+        auto start = std::chrono::steady_clock::now();
+        Scene &built = scenes[name];
+        if (const SceneDesc *desc = findScene(name))
+            desc->build(built);
+        std::printf("built %s in %.1f ms\n", name.c_str(), msSince(start));
+        return built;
+    }
+
+    RenderServer::Resident *RenderServer::acquire(const RenderJob &job, std::string &error)
+    {
+        for (std::unique_ptr<Resident> &resident : residents)
+        {
+            if (resident->scene == job.scene && resident->width == job.width && resident->height == job.height)
+            {
+                resident->lastUsed = ++uses;
+                return resident.get();
+            }
+        }
+
+        // the least recently used one makes room
+        if (!residents.empty() && residents.size() >= std::max<size_t>(1, options.resident))
+        {
+            auto oldest = std::min_element(residents.begin(), residents.end(), [](const std::unique_ptr<Resident> &a, const std::unique_ptr<Resident> &b)
+                                           { return a->lastUsed < b->lastUsed; });
+            residents.erase(oldest);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto resident = std::make_unique<Resident>();
+        resident->scene = job.scene;
+        resident->width = job.width;
+        resident->height = job.height;
+        resident->lastUsed = ++uses;
+
+        const Scene &loaded = scene(job.scene);
+        if (options.cpu)
+        {
+            resident->tracer = std::make_unique<CPUTracer>(job.width, job.height, options.threads);
+            resident->tracer->loadScene(loaded);
+        }
+        else
+        {
+            resident->renderer = std::make_unique<Renderer>(job.width, job.height);
+            resident->renderer->reprojection = false;
+            if (!resident->renderer->loadScene(loaded))
+            {
+                error = "loading " + job.scene + " failed";
+                return nullptr;
+            }
+        }
+        std::printf("loaded %s at %ux%u in %.1f ms\n", job.scene.c_str(), job.width, job.height, msSince(start));
+
+        residents.push_back(std::move(resident));
+        residentCount = residents.size();
+        return residents.back().get();
+    }
+
+    RenderResult RenderServer::render(const RenderJob &job)
+    {
+        auto start = std::chrono::steady_clock::now();
+        RenderResult result;
+        Resident *resident = acquire(job, result.error);
+        if (!resident)
+            return result;
+
+        const SceneDesc &desc = *findScene(job.scene);
+        Camera camera = job.customCamera ? Camera(90.0f, 6.0f, job.yaw, job.pitch, job.position) : orbitCamera(desc, job.orbit);
+
+        if (resident->tracer)
+        {
+            CPUTracer &tracer = *resident->tracer;
+            tracer.samplerType = job.samplerType;
+            tracer.resetAccumulation();
+            while (tracer.sampleIndex < job.spp)
+            {
+                tracer.setSamplesPerPixel(std::min(MAX_SPP_PER_DISPATCH, job.spp - tracer.sampleIndex));
+                tracer.trace(camera);
+            }
+
+            result.pixels.resize(tracer.accum.size() * 4);
+            std::memcpy(result.pixels.data(), tracer.accum.data(), result.pixels.size() * sizeof(float));
+        }
+        else
+        {
+            Renderer &renderer = *resident->renderer;
+            renderer.samplerType = job.samplerType;
+            renderer.denoiser.enabled = job.denoise;
+            renderer.resetAccumulation();
+            while (renderer.sampleIndex < job.spp)
+            {
+                renderer.setSamplesPerPixel(std::min(MAX_SPP_PER_DISPATCH, job.spp - renderer.sampleIndex));
+                if (!renderer.trace(camera, false))
+                {
+                    result.error = "raytracer dispatch failed";
+                    return result;
+                }
+                glFinish();
+            }
+
+            result.pixels = readImageTexture(renderer.denoise(), job.width, job.height);
+        }
+
+        result.ok = true;
+        result.renderMs = msSince(start);
+        return result;
+    }
+
+    void printServerUsage()
+    {
+        std::cerr << "usage: engine --serve socket [--backend gpu|cpu] [--threads n] [--resident n] [--max-size n]\n"
+                     "                      [--preload scene,...]\n"
+                     "       engine --submit socket [--status | --shutdown | --key value ... --out image.pfm|.hdr|.ppm ...]"
+                  << std::endl;
+    }
+}
+
+int runServer(int argc, char **argv)
+{
+    ServerOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printServerUsage();
+            return -1;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--serve")
+            options.socketPath = value;
+        else if (arg == "--backend")
+        {
+            if (value != "gpu" && value != "cpu")
+            {
+                std::cerr << "--backend expects gpu or cpu" << std::endl;
+                printServerUsage();
+                return -1;
+            }
+            options.cpu = value == "cpu";
+        }
+        else if (arg == "--threads")
+            options.threads = std::max(0, std::atoi(value.c_str()));
+        else if (arg == "--resident")
+            options.resident = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--max-size")
+            options.maxSize = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--preload")
+        {
+            std::stringstream stream(value);
+            std::string name;
+            while (std::getline(stream, name, ','))
+            {
+                if (!findScene(name))
+                {
+                    std::cerr << "Unknown scene " << name << std::endl;
+                    return -1;
+                }
+                options.preload.push_back(name);
+            }
+        }
+        else
+        {
+            printServerUsage();
+            return -1;
+        }
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGPIPE, SIG_IGN); // clients that hang up show up as failed writes
+
+    RenderServer server(options);
+    return server.run();
+}
+
+int runSubmit(int argc, char **argv)
+{
+    std::string path;
+    std::string request = "render";
+    std::vector<std::string> outputs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--status" || arg == "--shutdown")
+            request = arg.substr(2);
+        else if (arg == "--denoise")
+            request += " denoise=1";
+        else if (arg.compare(0, 2, "--") == 0 && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if (arg == "--submit")
+                path = value;
+            else if (arg == "--out")
+                outputs.push_back(value);
+            else
+                request += " " + arg.substr(2) + "=" + value;
+        }
+        else
+        {
+            printServerUsage();
+            return -1;
+        }
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    int fd = connectTo(path);
+    if (fd < 0)
+    {
+        std::cerr << "no server listening on " << path << std::endl;
+        return -1;
+    }
+
+    std::string pending, header;
+    if (!writeLine(fd, request) || !readLine(fd, pending, header))
+    {
+        std::cerr << "the server hung up" << std::endl;
+        close(fd);
+        return -1;
+    }
+    if (header.compare(0, 2, "ok") != 0)
+    {
+        std::cerr << header << std::endl;
+        close(fd);
+        return -1;
+    }
+    std::cout << header << std::endl;
+    if (request.compare(0, 6, "render") != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    // -- Image -- the header line may have been read together with the first pixels
+    unsigned int width = std::strtoul(headerValue(header, "width").c_str(), nullptr, 10);
+    unsigned int height = std::strtoul(headerValue(header, "height").c_str(), nullptr, 10);
+    size_t bytes = std::strtoull(headerValue(header, "bytes").c_str(), nullptr, 10);
+    std::vector<float> pixels(bytes / sizeof(float));
+    size_t buffered = std::min(pending.size(), bytes);
+    std::memcpy(pixels.data(), pending.data(), buffered);
+    bool received = readAll(fd, reinterpret_cast<char *>(pixels.data()) + buffered, bytes - buffered);
+    close(fd);
+    if (!received || pixels.size() != size_t(width) * height * 4)
+    {
+        std::cerr << "the server hung up before sending the whole image" << std::endl;
+        return -1;
+    }
+
+    for (const std::string &output : outputs)
+    {
+        if (!writeImage(output, width, height, pixels))
+            return -1;
+        std::cout << "wrote " << output << std::endl;
+    }
+    return 0;
+}
+
+#else
+
+int runServer(int, char **)
+{
+    std::cerr << "--serve needs UNIX domain sockets" << std::endl;
+    return -1;
+}
+
+int runSubmit(int, char **)
+{
+    std::cerr << "--submit needs UNIX domain sockets" << std::endl;
+    return -1;
+}
+
+#endif
@@ -1,4 +1,29 @@
 #include "shader.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    long processId()
+    {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return getpid();
+#endif
+    }
+}
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath, ShaderType type)
 {
@@ -57,7 +82,7 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath, ShaderType type
     if (!success)
     {
         glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
+        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
                   << infoLog << std::endl;
     };
 
@@ -69,7 +94,7 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath, ShaderType type
     if (!success)
     {
         glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
+        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
                   << infoLog << std::endl;
     };
 
@@ -82,15 +107,18 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath, ShaderType type
     if (!success)
     {
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
                   << infoLog << std::endl;
     }
 
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    if (success)
+        reflect();
 }
 
-Shader::Shader(const char *computePath)
+Shader::Shader(const char *computePath, const std::vector<std::string> &defines) : compute(true)
 {
     std::ifstream file(computePath);
     if (!file.is_open())
@@ -103,6 +131,37 @@ Shader::Shader(const char *computePath)
     std::stringstream buffer;
     buffer << file.rdbuf();
     std::string sourceStr = buffer.str();
+
+    if (!defines.empty())
+    {
+        // defines must come after #version, #line keeps compiler errors pointing at the file
+        size_t versionEnd = sourceStr.find('\n', sourceStr.find("#version"));
+        if (versionEnd == std::string::npos)
+        {
+            std::cerr << "ERROR: Compute shader has no #version line: "
+                      << computePath << std::endl;
+            return;
+        }
+
+        size_t nextLine = std::count(sourceStr.begin(), sourceStr.begin() + versionEnd, '\n') + 2;
+
+        std::string injected;
+        for (const std::string &define : defines)
+            injected += "#define " + define + "\n";
+        injected += "#line " + std::to_string(nextLine) + "\n";
+
+        sourceStr.insert(versionEnd + 1, injected);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::string cachePath = binaryCachePath(sourceStr);
+    if (loadBinary(cachePath))
+    {
+        std::cerr << "shader cache hit: " << computePath << " loaded in " << msSince(start) << " ms\n";
+        return;
+    }
+
     const char *source = sourceStr.c_str();
 
     GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
@@ -120,6 +179,7 @@ Shader::Shader(const char *computePath)
     }
 
     ID = glCreateProgram();
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glAttachShader(ID, computeShader);
     glLinkProgram(ID);
 
@@ -133,34 +193,304 @@ Shader::Shader(const char *computePath)
     }
 
     glDeleteShader(computeShader);
+
+    if (success)
+    {
+        reflect();
+        saveBinary(cachePath);
+    }
+    std::cerr << "shader cache miss: " << computePath << " compiled in " << msSince(start) << " ms\n";
+}
+
+// -- Program Binary Cache --
+
+namespace
+{
+    constexpr uint32_t BINARY_MAGIC = 0x52544250; // "RTBP"
+
+    struct BinaryHeader
+    {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    uint64_t fnv1a(const std::string &data, uint64_t hash = 0xcbf29ce484222325ull)
+    {
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte *str = glGetString(name);
+        return str ? reinterpret_cast<const char *>(str) : "";
+    }
+}
+
+std::string Shader::binaryCachePath(const std::string &source)
+{
+    // binaries are only valid for the exact driver that produced them
+    uint64_t hash = fnv1a(source);
+    hash = fnv1a(glString(GL_VENDOR), hash);
+    hash = fnv1a(glString(GL_RENDERER), hash);
+    hash = fnv1a(glString(GL_VERSION), hash);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+    return std::string(BINARY_CACHE_DIR) + "/" + name;
+}
+
+bool Shader::loadBinary(const std::string &path)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0)
+        return false;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    BinaryHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || header.magic != BINARY_MAGIC)
+        return false;
+
+    // a truncated or corrupt entry can't claim more than the file holds
+    std::streampos dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff available = file.tellg() - dataStart;
+    file.seekg(dataStart);
+    if (!file || header.length == 0 || std::streamoff(header.length) > available)
+        return false;
+
+    std::vector<char> binary(header.length);
+    file.read(binary.data(), header.length);
+    if (!file)
+        return false;
+
+    ID = glCreateProgram();
+    glProgramBinary(ID, header.format, binary.data(), header.length);
+
+    GLint success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // stale entry (driver update etc.), recompiling overwrites it
+        std::cerr << "shader cache: rejected stale binary " << path << "\n";
+        glDeleteProgram(ID);
+        ID = 0;
+        return false;
+    }
+
+    reflect();
+    return true;
+}
+
+void Shader::saveBinary(const std::string &path) const
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    BinaryHeader header{BINARY_MAGIC, 0, static_cast<uint32_t>(length)};
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(ID, length, nullptr, &format, binary.data());
+    header.format = format;
+
+    std::error_code ec;
+    std::filesystem::create_directories(BINARY_CACHE_DIR, ec);
+
+    // written aside and renamed into place, other processes may be loading the same entry
+    std::string temporary = path + ".tmp." + std::to_string(processId());
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "WARN: Could not write shader cache entry " << path << std::endl;
+            return;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file)
+        {
+            std::cerr << "WARN: Could not write shader cache entry " << path << std::endl;
+            file.close();
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, ec);
+    if (ec)
+    {
+        std::cerr << "WARN: Could not write shader cache entry " << path << " (" << ec.message() << ")" << std::endl;
+        std::filesystem::remove(temporary, ec);
+    }
+}
+
+void Shader::dispatch(unsigned int width, unsigned int height) const
+{
+    glDispatchCompute(
+        (width + workGroupSize[0] - 1) / workGroupSize[0],
+        (height + workGroupSize[1] - 1) / workGroupSize[1],
+        1);
 }
 
 void Shader::setBool(const std::string &name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(uniformLocation(name), (int)value);
 }
 
 void Shader::setInt(const std::string &name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(uniformLocation(name), value);
+}
+
+void Shader::setUint(const std::string &name, unsigned int value) const
+{
+    glUniform1ui(uniformLocation(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(uniformLocation(name), value);
 }
 
 void Shader::setMat4(const std::string &name, glm::mat4 value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::setVec3(const std::string &name, glm::vec3 value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    glUniform3fv(uniformLocation(name), 1, glm::value_ptr(value));
 }
 
 void Shader::setVec2(const std::string &name, glm::vec2 value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    glUniform2fv(uniformLocation(name), 1, glm::value_ptr(value));
+}
+
+// -- Reflection --
+
+void Shader::reflect()
+{
+    uniforms.clear();
+    blocks.clear();
+
+    if (compute)
+        glGetProgramiv(ID, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
+
+    GLint count = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const GLenum props[] = {GL_BLOCK_INDEX, GL_LOCATION, GL_NAME_LENGTH};
+        GLint values[3];
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 3, props, 3, nullptr, values);
+        if (values[0] != -1) // block members have no location
+            continue;
+
+        std::string name(values[2], '\0');
+        glGetProgramResourceName(ID, GL_UNIFORM, i, values[2], nullptr, name.data());
+        name.pop_back(); // null terminator
+        uniforms[name] = values[1];
+
+        // arrays are reported as "name[0]", allow plain "name" too
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            uniforms[name.substr(0, name.size() - 3)] = values[1];
+    }
+
+    for (GLenum programInterface : {GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK})
+    {
+        glGetProgramInterfaceiv(ID, programInterface, GL_ACTIVE_RESOURCES, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLenum props[] = {GL_BUFFER_BINDING, GL_NAME_LENGTH};
+            GLint values[2];
+            glGetProgramResourceiv(ID, programInterface, i, 2, props, 2, nullptr, values);
+
+            std::string name(values[1], '\0');
+            glGetProgramResourceName(ID, programInterface, i, values[1], nullptr, name.data());
+            name.pop_back();
+            blocks[name] = values[0];
+        }
+    }
+}
+
+GLint Shader::uniformLocation(const std::string &name) const
+{
+    auto it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
+}
+
+GLint Shader::blockBinding(GLenum programInterface, const std::string &block) const
+{
+    if (glGetProgramResourceIndex(ID, programInterface, block.c_str()) == GL_INVALID_INDEX)
+        return -1;
+    auto it = blocks.find(block);
+    return it == blocks.end() ? -1 : it->second;
+}
+
+bool Shader::checkLayout(GLenum programInterface, const std::string &prefix, size_t stride, std::initializer_list<LayoutField> fields) const
+{
+    bool ok = true;
+    for (const LayoutField &field : fields)
+    {
+        std::string name = prefix + field.name;
+        GLuint index = glGetProgramResourceIndex(ID, programInterface, name.c_str());
+        if (index == GL_INVALID_INDEX)
+            continue; // optimized out or compiled out by a permutation
+
+        GLint offset = 0;
+        const GLenum offsetProp = GL_OFFSET;
+        glGetProgramResourceiv(ID, programInterface, index, 1, &offsetProp, 1, nullptr, &offset);
+        if (static_cast<size_t>(offset) != field.offset)
+        {
+            std::cerr << "ERROR: Layout mismatch: " << name << " is at offset " << offset
+                      << " in the shader but " << field.offset << " in C++" << std::endl;
+            ok = false;
+        }
+
+        if (stride == 0 || programInterface != GL_BUFFER_VARIABLE)
+            continue;
+
+        // arrays of structs report their stride on the members, arrays of scalars on the variable itself
+        GLint strides[2] = {0, 0};
+        const GLenum strideProps[] = {GL_TOP_LEVEL_ARRAY_STRIDE, GL_ARRAY_STRIDE};
+        glGetProgramResourceiv(ID, programInterface, index, 2, strideProps, 2, nullptr, strides);
+        GLint arrayStride = strides[0] != 0 ? strides[0] : strides[1];
+        if (static_cast<size_t>(arrayStride) != stride)
+        {
+            std::cerr << "ERROR: Layout mismatch: " << name << " has an array stride of " << arrayStride
+                      << " bytes in the shader but " << stride << " in C++" << std::endl;
+            ok = false;
+            stride = 0; // report once
+        }
+    }
+    return ok;
+}
+
+bool Shader::checkBlockBinding(GLenum programInterface, const std::string &block, GLint binding) const
+{
+    GLint actual = blockBinding(programInterface, block);
+    if (actual == -1 || actual == binding)
+        return true;
+
+    std::cerr << "ERROR: Binding mismatch: " << block << " is bound to " << actual
+              << " in the shader but " << binding << " in C++" << std::endl;
+    return false;
 }
\ No newline at end of file
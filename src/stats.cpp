@@ -0,0 +1,71 @@
+#include "stats.h"
+#include "layouts.h"
+
+#include <algorithm>
+#include <vector>
+
+TraversalStats::TraversalStats(unsigned int width, unsigned int height) : width(width), height(height) {}
+
+TraversalStats::~TraversalStats()
+{
+    if (ssbo != 0)
+        glDeleteBuffers(1, &ssbo);
+}
+
+void TraversalStats::bind()
+{
+    if (ssbo == 0)
+    {
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(
+            GL_SHADER_STORAGE_BUFFER,
+            size_t(width) * height * sizeof(GPUPixelStats),
+            nullptr,
+            GL_DYNAMIC_READ);
+
+        GLuint zero = 0;
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding::TRAVERSAL_STATS, ssbo);
+}
+
+void TraversalStats::reduce()
+{
+    if (ssbo == 0)
+        return;
+
+    std::vector<GPUPixelStats> pixels(size_t(width) * height);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pixels.size() * sizeof(GPUPixelStats), pixels.data());
+
+    // 64 bit sums, a frame at high spp overflows 32 bits
+    uint64_t nodes = 0, aabbTests = 0, triangleTests = 0, rays = 0, bounces = 0, paths = 0;
+    maxNodes = 0;
+    std::fill(std::begin(viewMax), std::end(viewMax), 0.0f);
+
+    for (const GPUPixelStats &pixel : pixels)
+    {
+        nodes += pixel.nodes;
+        aabbTests += pixel.aabbTests;
+        triangleTests += pixel.triangleTests;
+        rays += pixel.rays;
+        bounces += pixel.bounces;
+        paths += pixel.paths;
+        maxNodes = std::max(maxNodes, pixel.maxNodes);
+
+        // same per pixel values as pass.frag
+        float pixelRays = std::max(float(pixel.rays), 1.0f);
+        viewMax[NODES] = std::max(viewMax[NODES], pixel.nodes / pixelRays);
+        viewMax[AABB_TESTS] = std::max(viewMax[AABB_TESTS], pixel.aabbTests / pixelRays);
+        viewMax[TRIANGLE_TESTS] = std::max(viewMax[TRIANGLE_TESTS], pixel.triangleTests / pixelRays);
+        viewMax[BOUNCES] = std::max(viewMax[BOUNCES], pixel.bounces / std::max(float(pixel.paths), 1.0f));
+    }
+
+    double perRay = rays > 0 ? 1.0 / rays : 0.0;
+    nodesPerRay = nodes * perRay;
+    aabbTestsPerRay = aabbTests * perRay;
+    triangleTestsPerRay = triangleTests * perRay;
+    bouncesPerPath = paths > 0 ? double(bounces) / paths : 0.0;
+}
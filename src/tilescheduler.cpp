@@ -0,0 +1,227 @@
+#include "tilescheduler.h"
+#include "numa.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+    // distance of (x, y) along the Hilbert curve over an n x n grid, n a power of two
+    uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+    {
+        uint64_t d = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2)
+        {
+            uint32_t rx = (x & s) > 0;
+            uint32_t ry = (y & s) > 0;
+            d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+            // rotate the quadrant so the curve continues where the last one ended
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+}
+
+std::vector<uint32_t> TileScheduler::hilbertOrder(uint32_t tilesX, uint32_t tilesY)
+{
+    uint32_t n = 1;
+    while (n < tilesX || n < tilesY)
+        n *= 2;
+
+    // grids that aren't square powers of two skip the curve's cells outside of them
+    std::vector<std::pair<uint64_t, uint32_t>> keyed;
+    keyed.reserve(size_t(tilesX) * tilesY);
+    for (uint32_t y = 0; y < tilesY; y++)
+        for (uint32_t x = 0; x < tilesX; x++)
+            keyed.push_back({hilbertIndex(n, x, y), y * tilesX + x});
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<uint32_t> tiles;
+    tiles.reserve(keyed.size());
+    for (const auto &entry : keyed)
+        tiles.push_back(entry.second);
+    return tiles;
+}
+
+TileScheduler::~TileScheduler()
+{
+    stopPool();
+}
+
+void TileScheduler::startPool(unsigned int count)
+{
+    stopPool();
+    for (unsigned int w = 1; w <= count; w++)
+        threads.emplace_back(&TileScheduler::poolLoop, this, w, generation); // so the next run is new to them
+}
+
+void TileScheduler::stopPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+    threads.clear();
+    stopping = false;
+}
+
+void TileScheduler::poolLoop(unsigned int worker, uint64_t seen)
+{
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (true)
+    {
+        wake.wait(lock, [&]
+                  { return stopping || generation != seen; });
+        if (stopping)
+            return;
+        seen = generation;
+
+        lock.unlock();
+        runWorker(worker);
+        lock.lock();
+
+        if (--running == 0)
+            finished.notify_one();
+    }
+}
+
+void TileScheduler::run(uint32_t tilesX, uint32_t tilesY, unsigned int threadCount, const std::function<void(uint32_t tile, unsigned int worker)> &work)
+{
+    auto start = std::chrono::steady_clock::now();
+    threadCount = std::max(1u, threadCount);
+
+    if (tilesX != orderX || tilesY != orderY)
+    {
+        order = hilbertOrder(tilesX, tilesY);
+        orderX = tilesX;
+        orderY = tilesY;
+    }
+    if (queueCount != threadCount)
+    {
+        queues.reset(new WorkerQueue[threadCount]);
+        queueCount = threadCount;
+    }
+    if (stats.size() != threadCount)
+        stats.assign(threadCount, WorkerStats{});
+
+    // -- Seeding -- contiguous stretches of the curve, as even as they get
+    for (unsigned int w = 0; w < threadCount; w++)
+    {
+        size_t first = order.size() * w / threadCount;
+        size_t last = order.size() * (w + 1) / threadCount;
+        queues[w].tiles.assign(order.begin() + first, order.begin() + last);
+    }
+
+    // -- Workers -- wake the pool, work as worker 0, wait for the pool to finish
+    if (threads.size() != threadCount - 1)
+        startPool(threadCount - 1);
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        currentWork = &work;
+        running = threadCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runWorker(0);
+
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        finished.wait(lock, [this]
+                      { return running == 0; });
+        currentWork = nullptr;
+    }
+
+    runMs += msSince(start);
+}
+
+void TileScheduler::runWorker(unsigned int w)
+{
+    std::unique_ptr<ThreadPin> pin;
+    if (!workerCpus.empty())
+        pin.reset(new ThreadPin(workerCpus[w % workerCpus.size()]));
+
+    WorkerStats local;
+    uint32_t tile;
+    while (true)
+    {
+        if (!pop(w, tile))
+        {
+            if (!steal(w, tile))
+                break;
+            local.steals++;
+        }
+
+        auto tileStart = std::chrono::steady_clock::now();
+        (*currentWork)(tile, w);
+        local.busyMs += msSince(tileStart);
+        local.tiles++;
+    }
+
+    // each worker only writes its own entry
+    stats[w].tiles += local.tiles;
+    stats[w].steals += local.steals;
+    stats[w].busyMs += local.busyMs;
+}
+
+bool TileScheduler::pop(unsigned int worker, uint32_t &tile)
+{
+    std::lock_guard<std::mutex> lock(queues[worker].mutex);
+    if (queues[worker].tiles.empty())
+        return false;
+    tile = queues[worker].tiles.front();
+    queues[worker].tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::steal(unsigned int worker, uint32_t &tile)
+{
+    // tiles never get added during a run, so one empty pass over every victim means all are taken
+    for (unsigned int i = 1; i < queueCount; i++)
+    {
+        WorkerQueue &victim = queues[(worker + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tiles.empty())
+            continue;
+        tile = victim.tiles.back();
+        victim.tiles.pop_back();
+        return true;
+    }
+    return false;
+}
+
+double TileScheduler::utilization(unsigned int worker) const
+{
+    return worker < stats.size() && runMs > 0.0 ? stats[worker].busyMs / runMs : 0.0;
+}
+
+void TileScheduler::resetStats()
+{
+    stats.assign(stats.size(), WorkerStats{});
+    runMs = 0.0;
+}
+
+void TileScheduler::printStats() const
+{
+    std::printf("%6s %10s %8s %10s %12s\n", "thread", "tiles", "steals", "busy ms", "utilization");
+    for (size_t w = 0; w < stats.size(); w++)
+        std::printf("%6zu %10llu %8llu %10.1f %11.1f%%\n", w, (unsigned long long)stats[w].tiles,
+                    (unsigned long long)stats[w].steals, stats[w].busyMs, 100.0 * utilization(w));
+    std::printf("wall %.1f ms\n", runMs);
+}
@@ -0,0 +1,156 @@
+#include "widebvh.h"
+#include "packet_kernel.h"
+
+namespace
+{
+    float surfaceArea(const BVH::GPUNode &node)
+    {
+        glm::vec3 size = glm::vec3(node.max) - glm::vec3(node.min);
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+}
+
+template <uint32_t W>
+WideBVH<W>::WideBVH(const std::vector<BVH::GPUNode> &binary, const std::vector<GPUTriangle> &triangles)
+{
+    if (!binary.empty())
+        collapse(binary, triangles, 0);
+}
+
+template <uint32_t W>
+uint32_t WideBVH<W>::collapse(const std::vector<BVH::GPUNode> &binary, const std::vector<GPUTriangle> &triangles, uint32_t index)
+{
+    // only a root can be a leaf, it then becomes the single child
+    uint32_t children[W];
+    uint32_t count = 0;
+    if (binary[index].triangleCount > 0)
+    {
+        children[count++] = index;
+    }
+    else
+    {
+        children[count++] = binary[index].left;
+        children[count++] = binary[index].right;
+    }
+
+    while (count < W)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const BVH::GPUNode &child = binary[children[i]];
+            if (child.triangleCount == 0 && surfaceArea(child) > largestArea)
+            {
+                largest = i;
+                largestArea = surfaceArea(child);
+            }
+        }
+        if (largest < 0)
+            break; // only leaves left
+
+        uint32_t pulled = children[largest];
+        children[largest] = binary[pulled].left;
+        children[count++] = binary[pulled].right;
+    }
+
+    // the vector grows while children are collapsed, so the node is filled in locally
+    uint32_t nodeIndex = nodes.size();
+    nodes.emplace_back();
+
+    Node node{};
+    node.childCount = count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const BVH::GPUNode &child = binary[children[i]];
+        node.minX[i] = child.min.x;
+        node.minY[i] = child.min.y;
+        node.minZ[i] = child.min.z;
+        node.maxX[i] = child.max.x;
+        node.maxY[i] = child.max.y;
+        node.maxZ[i] = child.max.z;
+        node.child[i] = child.triangleCount > 0 ? LEAF | addLeaf(child, triangles) : collapse(binary, triangles, children[i]);
+    }
+
+    nodes[nodeIndex] = node;
+    return nodeIndex;
+}
+
+template <uint32_t W>
+uint32_t WideBVH<W>::addLeaf(const BVH::GPUNode &node, const std::vector<GPUTriangle> &triangles)
+{
+    Leaf leaf{static_cast<uint32_t>(blocks.size()), (node.triangleCount + W - 1) / W};
+
+    for (uint32_t first = 0; first < node.triangleCount; first += W)
+    {
+        TriangleBlock block{};
+        for (uint32_t lane = 0; lane < W; lane++)
+        {
+            block.triangle[lane] = RayPacket::NO_HIT;
+            if (first + lane >= node.triangleCount)
+                continue;
+
+            // same arithmetic as the scalar traversal, so the kernels find the same hits
+            uint32_t index = node.left + first + lane;
+            const GPUTriangle &tri = triangles[index];
+            float e1[3] = {tri.b.x - tri.a.x, tri.b.y - tri.a.y, tri.b.z - tri.a.z};
+            float e2[3] = {tri.c.x - tri.a.x, tri.c.y - tri.a.y, tri.c.z - tri.a.z};
+
+            block.ax[lane] = tri.a.x;
+            block.ay[lane] = tri.a.y;
+            block.az[lane] = tri.a.z;
+            block.e1x[lane] = e1[0];
+            block.e1y[lane] = e1[1];
+            block.e1z[lane] = e1[2];
+            block.e2x[lane] = e2[0];
+            block.e2y[lane] = e2[1];
+            block.e2z[lane] = e2[2];
+            block.nx[lane] = e1[1] * e2[2] - e1[2] * e2[1];
+            block.ny[lane] = e1[2] * e2[0] - e1[0] * e2[2];
+            block.nz[lane] = e1[0] * e2[1] - e1[1] * e2[0];
+            block.triangle[lane] = index;
+        }
+        blocks.push_back(block);
+    }
+
+    leaves.push_back(leaf);
+    return leaves.size() - 1;
+}
+
+template struct WideBVH<4>;
+template struct WideBVH<8>;
+
+uint32_t wideBVHWidth(PacketISA isa)
+{
+    if (!packetISASupported(isa))
+        return 0;
+    if (isa >= ISA_AVX2 && packetISASupported(ISA_AVX2))
+        return 8; // an 8 wide kernel already fills a 256 bit register, AVX-512 runs the AVX2 one
+    if (isa >= ISA_SSE && packetISASupported(ISA_SSE))
+        return 4;
+    return 0;
+}
+
+void intersectWide(const WideBVH<4>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle)
+{
+    static const WideKernel<4> kernel = wideKernelSSE();
+    kernel(bvh, origin, direction, tMax, triangle);
+}
+
+void intersectWide(const WideBVH<8>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle)
+{
+    static const WideKernel<8> kernel = wideKernelAVX2();
+    kernel(bvh, origin, direction, tMax, triangle);
+}
+
+void intersectWideAny(const WideBVH<4>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle)
+{
+    static const WideKernel<4> kernel = wideOcclusionKernelSSE();
+    kernel(bvh, origin, direction, tMax, triangle);
+}
+
+void intersectWideAny(const WideBVH<8>::View &bvh, const float origin[3], const float direction[3], float &tMax, uint32_t &triangle)
+{
+    static const WideKernel<8> kernel = wideOcclusionKernelAVX2();
+    kernel(bvh, origin, direction, tMax, triangle);
+}
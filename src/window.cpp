@@ -1,6 +1,6 @@
 #include "window.h"
 
-Window::Window(unsigned int width, unsigned int height, const char *title) : SCR_WIDTH(width), SCR_HEIGHT(height)
+Window::Window(unsigned int width, unsigned int height, const char *title, bool visible) : SCR_WIDTH(width), SCR_HEIGHT(height)
 {
     if (!glfwInit())
         return;
@@ -8,6 +8,7 @@ Window::Window(unsigned int width, unsigned int height, const char *title) : SCR
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE); // TODO: Handle resizing properly.
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);